@@ -0,0 +1,118 @@
+/** @file srgb.h
+ *  @brief The sRGB transfer function, and tables based on it.
+ */
+#ifndef COLOR_SRGB_H_
+#define COLOR_SRGB_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/** @brief Convert an sRGB value to linear intensity.
+ *
+ *  Both values are in the range [0, 1]. This is the same curve as in the
+ *  built-in sRGB profile of LCMS (IEC 61966-2-1).
+ */
+inline double srgbToLinear(double v)
+{
+  return (v <= 0.04045)?(v/12.92):std::pow((v + 0.055)/1.055, 2.4);
+}
+
+/// Convert a linear intensity to an sRGB value; the inverse of srgbToLinear.
+inline double linearToSrgb(double v)
+{
+  return (v <= 0.0031308)?(v*12.92):(1.055*std::pow(v, 1/2.4) - 0.055);
+}
+
+/** @brief Matrix from linear sRGB to CIE XYZ, adapted to D50.
+ *
+ *  The columns are the colorants of the built-in sRGB profile of LCMS, so
+ *  this gives the same XYZ values as an LCMS transform into its XYZ profile.
+ */
+const double srgbToXyzD50[3][3] = {
+  {0.43604126, 0.38511291, 0.14304584},
+  {0.22248455, 0.71690509, 0.06061038},
+  {0.01392019, 0.09706724, 0.71391256}};
+
+/** @brief Tables for fast conversion between 8-bit sRGB values and linear
+ *         intensities.
+ *
+ *  The conversion from linear intensities rounds to the nearest 8-bit value,
+ *  exactly: a coarse table gives a first guess, which is corrected by
+ *  comparing with the exact decision thresholds.
+ */
+class SrgbTables {
+ public:
+  /// Get the shared instance.
+  static const SrgbTables& getInstance() {
+    static const SrgbTables instance;
+    return instance;
+  }
+
+  /// Get the linear intensity of an 8-bit sRGB value.
+  float toLinear(unsigned char v) const { return toLinear_[v]; }
+
+  /// Get the 8-bit sRGB value of a linear intensity, clamping to [0, 255].
+  unsigned char fromLinear(float v) const {
+    if (!(v > 0)) return 0;
+    if (v >= 1) return 255;
+    unsigned char c = guess_[(unsigned)(v*guessSize)];
+    while (c < 255 && v >= thresholds_[c + 1])
+      ++c;
+    return c;
+  }
+
+ private:
+  static const unsigned guessSize = 16384;
+
+  SrgbTables() {
+    for (unsigned i = 0; i < 256; ++i) {
+      toLinear_[i] = srgbToLinear(i/255.0);
+      // values from here on round to i or more
+      thresholds_[i] = srgbToLinear((i - 0.5)/255.0);
+    }
+    for (unsigned i = 0; i <= guessSize; ++i) {
+      // the value at the start of each bin, which is never too large
+      guess_[i] = std::floor(linearToSrgb((double)i/guessSize)*255 + 0.5);
+      while (guess_[i] > 0 && (double)i/guessSize < thresholds_[guess_[i]])
+        --guess_[i];
+    }
+  }
+  SrgbTables(const SrgbTables&);
+  SrgbTables& operator=(const SrgbTables&);
+
+  float           toLinear_[256];
+  float           thresholds_[256];
+  unsigned char   guess_[guessSize + 1];
+};
+
+/** @brief Make a table mapping each sRGB value of integer type @a T to the
+ *         value with the linear intensity multiplied by @a factor.
+ *
+ *  Results are clamped to the range of @a T and rounded to nearest, like
+ *  LCMS does when converting to integers. @a table must have room for one
+ *  entry per value: 256 for 8 bits, 65536 for 16 bits.
+ */
+template <class T>
+inline void makeSrgbScaleTable(double factor, T* table)
+{
+  const double max = std::numeric_limits<T>::max();
+  for (size_t i = 0; i <= max; ++i) {
+    const double v = linearToSrgb(std::min(1.0, srgbToLinear(i/max)*factor));
+    table[i] = std::floor(std::max(0.0, v)*max + 0.5);
+  }
+}
+
+/** @brief Like @a makeSrgbScaleTable for 8-bit values, but the results are
+ *         left unrounded, for quantizing later (with dithering, for
+ *         instance).
+ */
+inline void makeSrgbScaleTable(double factor, float* table)
+{
+  for (unsigned i = 0; i < 256; ++i) {
+    const double v = linearToSrgb(std::min(1.0, srgbToLinear(i/255.0)*factor));
+    table[i] = std::max(0.0, v)*255;
+  }
+}
+
+#endif
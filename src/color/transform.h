@@ -4,9 +4,16 @@
 #ifndef COLOR_TRANSFORM_H_
 #define COLOR_TRANSFORM_H_
 
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
 #include <lcms2.h>
 
+#include "image/image.h"
+#include "image/interleave.h"
 #include "misc/refcount.h"
+#include "misc/threadpool.h"
 
 inline void colorTransformDeleter(cmsHTRANSFORM h)
 {
@@ -42,6 +49,83 @@ class ColorTransform : public RefCount<cmsHTRANSFORM, colorTransformDeleter> {
     cmsDoTransform(handle_, (const void*)(&(*begin)), (void*)(&(*result)), 
       npixels);
   }
+
+  /** @brief Apply the transform to an image, placing the output in
+   *         @a result.
+   *
+   *  Unlike the iterator version, this respects the strides and offsets of
+   *  the images, so it works directly on the views produced by @a crop,
+   *  @a coarseRotate, @a flip, or @a selectChannel, without the need to
+   *  flatten them first. The two images must have the same size, and
+   *  @a result must already be allocated. The transformation can be done in
+   *  place, provided the input and output pixel formats have the same size.
+   *
+   *  The rows of the image are split between the threads of the shared
+   *  @a ThreadPool, using at most @a maxThreads threads (0 means no limit).
+   */
+  template <class T1, class T2>
+  void apply(const GenericImage<T1>& image, GenericImage<T2>& result,
+      size_t maxThreads = 0) const;
 };
 
+template <class T1, class T2>
+void ColorTransform::apply(const GenericImage<T1>& image,
+    GenericImage<T2>& result, size_t maxThreads) const
+{
+  if (image.getWidth() != result.getWidth() ||
+      image.getHeight() != result.getHeight())
+    throw std::runtime_error("[ColorTransform::apply] Size mismatch between "
+      "origin and destination image.");
+
+  const size_t width = image.getWidth();
+  const size_t height = image.getHeight();
+  if (width == 0 || height == 0)
+    return;
+
+  const size_t ncomps1 = image.getChannelCount();
+  const size_t ncomps2 = result.getChannelCount();
+  const int* strides1 = image.getStrides();
+  const int* strides2 = result.getStrides();
+  const int cstride1 = image.getChannelStride();
+  const int cstride2 = result.getChannelStride();
+
+  // lcms needs the pixels within a row to be adjacent in memory; rows that
+  // aren't (rotated views, channel selections, planar images) go through a
+  // scratch buffer
+  const bool contig1 = image.hasContiguousRows();
+  const bool contig2 = result.hasContiguousRows();
+  // lcms can only step forward from one row to the next
+  const bool blocks = (contig1 && contig2 && strides1[1] > 0 &&
+    strides2[1] > 0);
+
+  const cmsHTRANSFORM handle = handle_;
+  ThreadPool::getInstance().parallelFor(height,
+    [&](size_t y1, size_t y2) {
+      if (blocks) {
+        cmsDoTransformLineStride(handle, image(0, y1), result(0, y1), width,
+          y2 - y1, strides1[1]*sizeof(T1), strides2[1]*sizeof(T2), 0, 0);
+        return;
+      }
+
+      std::vector<T1> in(contig1?0:width*ncomps1);
+      std::vector<T2> out(contig2?0:width*ncomps2);
+      for (size_t y = y1; y < y2; ++y) {
+        const T1* src = image(0, y);
+        if (!contig1) {
+          copyPixelRow(src, strides1[0], cstride1, &in[0], ncomps1, 1, width,
+            ncomps1);
+          src = &in[0];
+        }
+
+        T2* dest = (contig2?result(0, y):&out[0]);
+        cmsDoTransform(handle, src, dest, width);
+
+        if (!contig2) {
+          copyPixelRow((const T2*)&out[0], ncomps2, 1, result(0, y),
+            strides2[0], cstride2, width, ncomps2);
+        }
+      }
+    }, 4, maxThreads);
+}
+
 #endif
@@ -0,0 +1,60 @@
+/** @file transformcache.h
+ *  @brief A cache of transforms between two fixed profiles.
+ */
+#ifndef COLOR_TRANSFORMCACHE_H_
+#define COLOR_TRANSFORMCACHE_H_
+
+#include <map>
+#include <utility>
+
+#include "profile.h"
+#include "transform.h"
+#include "transformfactory.h"
+
+/** @brief Transforms from one profile to another, for any pixel formats.
+ *
+ *  Creating an optimized LCMS transform takes much longer than applying it
+ *  to a small image, so effects that convert every frame keep the transforms
+ *  here, and only create one the first time a pair of pixel formats is seen.
+ *
+ *  Like the transforms themselves, this is not thread-safe.
+ */
+class ColorTransformCache {
+ public:
+  /// Constructor, for transforms from @a profile1 to @a profile2.
+  ColorTransformCache(const ColorProfile& profile1,
+      const ColorProfile& profile2, int intent = INTENT_PERCEPTUAL)
+    : profile1_(profile1), profile2_(profile2), intent_(intent) {}
+
+  /// Get the transform between LCMS pixel formats @a type1 and @a type2.
+  const ColorTransform& get(int type1, int type2) {
+    const std::pair<int, int> key(type1, type2);
+    auto i = transforms_.find(key);
+    if (i == transforms_.end()) {
+      i = transforms_.insert(std::make_pair(key,
+        ColorTransformFactory::fromProfiles(profile1_, type1, profile2_,
+          type2, intent_))).first;
+    }
+    return i -> second;
+  }
+
+  /// Get the transform between the pixel formats of two images.
+  template <class Image1, class Image2>
+  const ColorTransform& get(const Image1& image1, const Image2& image2) {
+    return get(
+      toLcmsType<typename Image1::value_type>(image1.getChannelTypes()),
+      toLcmsType<typename Image2::value_type>(image2.getChannelTypes()));
+  }
+
+  /// Get the source profile.
+  const ColorProfile& getSourceProfile() const { return profile1_; }
+  /// Get the target profile.
+  const ColorProfile& getTargetProfile() const { return profile2_; }
+
+ private:
+  ColorProfile                                      profile1_, profile2_;
+  int                                               intent_;
+  std::map<std::pair<int, int>, ColorTransform>     transforms_;
+};
+
+#endif
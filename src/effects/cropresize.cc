@@ -1,5 +1,6 @@
 #include "cropresize.h"
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 
@@ -41,32 +42,112 @@ std::ostream& operator<<(std::ostream& out, const Rectangle& rect)
   return out << rect.p1 << "-" << rect.p2;
 }
 
+// choose the sampler depending on whether we're shrinking or enlarging; with
+// a nonzero 'prereduce' property, large reductions start with a box filter
+template <class T>
+void set_sampler(Resizer<T>& resizer,
+    const std::map<std::string, double>& props, size_t w, size_t h,
+    size_t final_w, size_t final_h)
+{
+  resizer.setPreReduction(props.count("prereduce") > 0 &&
+    get_item(props, "prereduce") != 0);
+
+  double factorX = (double)final_w / w;
+  double factorY = (double)final_h / h;
+
+  if (factorX*factorY < 1)
+    resizer.setSampler(new LanczosSampler<T>);
+  else
+    resizer.setSampler(new CubicSampler<T>);
+}
+
 } // anonymous namespace
 
-void CropResizeEffect::operator()(Image8& image,
-    const std::map<std::string, double>& props, int verb)
+CropResizeEffect::Geometry CropResizeEffect::get_geometry(
+    const std::map<std::string, double>& props, size_t w, size_t h)
 {
   // default crop region: whole image
-  Rectangle crop_region{{0, 0}, {image.getWidth(), image.getHeight()}};
+  Geometry geom{0, 0, w, h, 0, 0, 0, 0, 0, 0};
   // adding +0.5 for rounding to nearest integer
   if (props.count("x0") > 0)
-    crop_region.p1.x = get_item(props, "x0") + 0.5;
+    geom.x0 = std::max(get_item(props, "x0"), 0.0) + 0.5;
   if (props.count("y0") > 0)
-    crop_region.p1.y = get_item(props, "y0") + 0.5;
+    geom.y0 = std::max(get_item(props, "y0"), 0.0) + 0.5;
   if (props.count("x1") > 0)
-    crop_region.p2.x = get_item(props, "x1") + 0.5;
+    geom.x1 = get_item(props, "x1") + 0.5;
   if (props.count("y1") > 0)
-    crop_region.p2.y = get_item(props, "y1") + 0.5;
-  // the +0.5 added to crop_region.p1 makes sure that crop_region.p2 are also
-  // rounded to the nearest integer
+    geom.y1 = get_item(props, "y1") + 0.5;
+  // the +0.5 added to geom.x0, geom.y0 makes sure that geom.x1, geom.y1 are
+  // also rounded to the nearest integer
   if (props.count("cwidth") > 0)
-    crop_region.p2.x = crop_region.p1.x + get_item(props, "cwidth");
+    geom.x1 = geom.x0 + get_item(props, "cwidth");
   if (props.count("cheight") > 0)
-    crop_region.p2.y = crop_region.p1.y + get_item(props, "cheight");
-  
-  if (crop_region.p1.x != 0 || crop_region.p1.y != 0 ||
-      crop_region.p2.x!=image.getWidth() || crop_region.p2.y!=image.getHeight())
-  {
+    geom.y1 = geom.y0 + get_item(props, "cheight");
+  // keep the region inside the image; the exact region below is clamped the
+  // same way, so that the two agree on whether the crop is fractional
+  geom.x1 = std::min(geom.x1, w);
+  geom.y1 = std::min(geom.y1, h);
+  geom.x0 = std::min(geom.x0, geom.x1);
+  geom.y0 = std::min(geom.y0, geom.y1);
+
+  // the exact region, if asked for
+  geom.fx0 = geom.x0;
+  geom.fy0 = geom.y0;
+  geom.fx1 = geom.x1;
+  geom.fy1 = geom.y1;
+  if (props.count("subpixel") > 0 && get_item(props, "subpixel") != 0) {
+    if (props.count("x0") > 0)
+      geom.fx0 = get_item(props, "x0");
+    if (props.count("y0") > 0)
+      geom.fy0 = get_item(props, "y0");
+    geom.fx1 = ((props.count("cwidth") > 0)?
+      geom.fx0 + get_item(props, "cwidth"):
+      ((props.count("x1") > 0)?get_item(props, "x1"):w));
+    geom.fy1 = ((props.count("cheight") > 0)?
+      geom.fy0 + get_item(props, "cheight"):
+      ((props.count("y1") > 0)?get_item(props, "y1"):h));
+    geom.fx0 = std::max(geom.fx0, 0.0);
+    geom.fy0 = std::max(geom.fy0, 0.0);
+    geom.fx1 = std::min(geom.fx1, (double)w);
+    geom.fy1 = std::min(geom.fy1, (double)h);
+  }
+
+  // default target size: same as crop region
+  geom.width = geom.x1 - geom.x0;
+  geom.height = geom.y1 - geom.y0;
+  if (props.count("twidth") > 0)
+    geom.width = get_item(props, "twidth") + 0.5;
+  if (props.count("theight") > 0)
+    geom.height = get_item(props, "theight") + 0.5;
+
+  return geom;
+}
+
+template <class T>
+void CropResizeEffect::apply_(GenericImage<T>& image, int verb)
+{
+  const PropertyMap& props = get_properties();
+  const Geometry geom = get_geometry(props, image.getWidth(),
+    image.getHeight());
+  const Rectangle crop_region{{geom.x0, geom.y0}, {geom.x1, geom.y1}};
+
+  if (geom.fractional()) {
+    // crop and resize in one pass
+    GenericImage<T> result;
+    result.reshape(geom.width, geom.height);
+    result.setChannelCount(image.getChannelCount());
+    result.allocate();
+    if (!render(image, result, props, verb))
+      throw std::runtime_error("[CropResizeEffect::apply] Could not crop and "
+        "resize the image.");
+    result.copyMetadataFrom(image);
+    result.setChannelTypes(image.getChannelTypes());
+    image = result;
+    return;
+  }
+
+
+  if (geom.crops(image.getWidth(), image.getHeight())) {
     // need to crop
     if (verb >= 2) {
       std::cout << "Cropping to " << crop_region << std::endl;
@@ -76,27 +157,128 @@ void CropResizeEffect::operator()(Image8& image,
       crop_region.p2.y - crop_region.p1.y);
   }
 
-  // default target size: same as crop region
-  Point final_size
-    {crop_region.p2.x - crop_region.p1.x, crop_region.p2.y - crop_region.p1.y};
-  if (props.count("twidth") > 0)
-    final_size.x = get_item(props, "twidth") + 0.5;
-  if (props.count("theight") > 0)
-    final_size.y = get_item(props, "theight") + 0.5;
+  const Point final_size{geom.width, geom.height};
 
   if (final_size.x != image.getWidth() || final_size.y != image.getHeight()) {
     // need to resize
     if (verb >= 2) {
       std::cout << "Resizing to " << final_size << std::endl;
     }
-    Resizer<Image8::value_type> resizer;
-    double factorX = (double)final_size.x / image.getWidth();
-    double factorY = (double)final_size.y / image.getHeight();
-
-    if (factorX*factorY < 1)
-      resizer.setSampler(new LanczosSampler<Image8::value_type>);
-    else
-      resizer.setSampler(new CubicSampler<Image8::value_type>);
+    Resizer<T> resizer;
+    set_sampler(resizer, props, image.getWidth(), image.getHeight(),
+      final_size.x, final_size.y);
     image = resizer.resize(image, final_size.x, final_size.y);
   }
 }
+
+template <class T>
+bool CropResizeEffect::render(const GenericImage<T>& image,
+    GenericImage<T>& target, const std::map<std::string, double>& props,
+    int verb)
+{
+  const Geometry geom = get_geometry(props, image.getWidth(),
+    image.getHeight());
+  if (geom.width != target.getWidth() || geom.height != target.getHeight())
+    return false;
+
+  if (geom.fractional()) {
+    if (verb >= 2) {
+      std::cout << "Cropping to (" << geom.fx0 << "," << geom.fy0 << ")-("
+                << geom.fx1 << "," << geom.fy1 << ") and resizing to "
+                << Point{geom.width, geom.height} << std::endl;
+    }
+    Resizer<T> resizer;
+    set_sampler(resizer, props, geom.x1 - geom.x0, geom.y1 - geom.y0,
+      geom.width, geom.height);
+    resizer.resize(image, geom.fx0, geom.fy0, geom.fx1, geom.fy1, target);
+    return true;
+  }
+
+  GenericImage<T> cropped(image);
+  if (geom.crops(image.getWidth(), image.getHeight())) {
+    if (verb >= 2) {
+      std::cout << "Cropping to " << Rectangle{{geom.x0, geom.y0},
+        {geom.x1, geom.y1}} << std::endl;
+    }
+    cropped.crop(geom.x0, geom.y0, geom.x1 - geom.x0, geom.y1 - geom.y0);
+  }
+
+  if (geom.resizes() && verb >= 2) {
+    std::cout << "Resizing to " << Point{geom.width, geom.height}
+              << " in place" << std::endl;
+  }
+  Resizer<T> resizer;
+  set_sampler(resizer, props, cropped.getWidth(), cropped.getHeight(),
+    geom.width, geom.height);
+  // this simply copies the pixels if there's no resizing to do
+  resizer.resize(cropped, target);
+
+  return true;
+}
+
+void CropResizeEffect::apply_planar(PlanarImage<unsigned char>& image,
+    const std::map<std::string, double>& props, int verb)
+{
+  const size_t w = image.getWidth();
+  const size_t h = image.getHeight();
+  const Geometry geom = get_geometry(props, w, h);
+  if (verb >= 2) {
+    if (geom.crops(w, h)) {
+      std::cout << "Cropping planes to " << Rectangle{{geom.x0, geom.y0},
+        {geom.x1, geom.y1}} << std::endl;
+    }
+    if (geom.resizes()) {
+      std::cout << "Resizing planes to " << Point{geom.width, geom.height}
+                << std::endl;
+    }
+  }
+
+  const PlanarImage<unsigned char>::Sampling max_sampling =
+    image.getMaxSampling();
+  for (size_t i = 0; i < image.getPlaneCount(); ++i) {
+    Image8& plane = image.getPlane(i);
+    const size_t sx = image.getSampling(i).h;
+    const size_t sy = image.getSampling(i).v;
+    const size_t hmax = max_sampling.h;
+    const size_t vmax = max_sampling.v;
+
+    // plane sample k is centered on full-resolution position
+    // (k + 0.5)/s - 0.5, where s is the relative resolution of the plane
+    const double s_x = (double)sx/hmax;
+    const double s_y = (double)sy/vmax;
+    const double f_x = (geom.fx1 - geom.fx0)/geom.width;
+    const double f_y = (geom.fy1 - geom.fy0)/geom.height;
+    const double px0 = std::max(0.0, geom.fx0*s_x + 0.5*(f_x - 1)*(1 - s_x));
+    const double py0 = std::max(0.0, geom.fy0*s_y + 0.5*(f_y - 1)*(1 - s_y));
+    const size_t final_w = image.getPlaneWidth(i, geom.width);
+    const size_t final_h = image.getPlaneHeight(i, geom.height);
+
+    if (f_x == 1 && f_y == 1 && px0 == std::floor(px0) &&
+        py0 == std::floor(py0)) {
+      // only cropping by whole pixels
+      plane.crop(px0, py0, final_w, final_h);
+      continue;
+    }
+
+    Resizer<Image8::value_type> resizer;
+    set_sampler(resizer, props, f_x*final_w, f_y*final_h, final_w, final_h);
+    Image8 resized;
+    resized.reshape(final_w, final_h);
+    resized.setChannelCount(plane.getChannelCount());
+    resized.allocate();
+    resizer.resize(plane, px0, py0, px0 + f_x*final_w, py0 + f_y*final_h,
+      resized);
+    resized.copyMetadataFrom(plane);
+    plane = resized;
+  }
+
+  image.reshape(geom.width, geom.height);
+}
+
+// the pixel types the processor works with
+template void CropResizeEffect::apply_(Image8&, int);
+template void CropResizeEffect::apply_(Image16&, int);
+template bool CropResizeEffect::render(const Image8&, Image8&,
+  const std::map<std::string, double>&, int);
+template bool CropResizeEffect::render(const Image16&, Image16&,
+  const std::map<std::string, double>&, int);
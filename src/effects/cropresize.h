@@ -7,15 +7,92 @@
 #include <string>
 #include <map>
 
-#include "image/image.h"
+#include <stdint.h>
 
-typedef GenericImage<unsigned char> Image8;
+#include "effects/effect.h"
+#include "image/image.h"
+#include "image/planarimage.h"
 
-/// Apply a crop and/or resize effect.
-class CropResizeEffect {
+/** @brief Apply a crop and/or resize effect.
+ *
+ *  The crop region is given by @a x0, @a y0 and either @a x1, @a y1 or
+ *  @a cwidth, @a cheight; the final size by @a twidth, @a theight. Setting
+ *  @a prereduce to a nonzero value makes large reductions faster, at some
+ *  cost in quality (see @a Resizer::setPreReduction).
+ *
+ *  The crop region is normally rounded to whole pixels. With a nonzero
+ *  @a subpixel property, it is used as given, and cropping and resizing are
+ *  done in a single resampling pass; this makes slow keyframed pans smooth,
+ *  instead of moving in steps of one pixel.
+ */
+class CropResizeEffect : public Effect {
  public:
-  /// Apply the effect with the properties given.
-  void operator()(Image8&, const std::map<std::string, double>&, int);
+  /// The crop region and final size of the image.
+  struct Geometry {
+    /// Crop region, from (@a x0, @a y0) inclusive to (@a x1, @a y1) exclusive.
+    size_t x0, y0, x1, y1;
+    /// Final size, after resizing.
+    size_t width, height;
+    /** @brief Crop region with sub-pixel precision.
+     *
+     *  This is the same as the integer region, unless the @a subpixel
+     *  property is set.
+     */
+    double fx0, fy0, fx1, fy1;
+
+    /// Whether the crop region has fractional coordinates.
+    bool fractional() const
+      { return fx0 != x0 || fy0 != y0 || fx1 != x1 || fy1 != y1; }
+    /// Whether the image needs cropping.
+    bool crops(size_t w, size_t h) const
+      { return x0 != 0 || y0 != 0 || x1 != w || y1 != h || fractional(); }
+    /// Whether the image needs resampling after the crop.
+    bool resizes() const
+      { return width != x1 - x0 || height != y1 - y0 || fractional(); }
+  };
+
+  /// Apply the effect with the current properties.
+  virtual void apply(Image8& image, int verb) { apply_(image, verb); }
+  /// Apply the effect with the current properties.
+  virtual void apply(Image16& image, int verb) { apply_(image, verb); }
+
+  /// Find the geometry for an image of size @a w x @a h.
+  static Geometry get_geometry(const std::map<std::string, double>&,
+    size_t w, size_t h);
+
+  /** @brief Apply the effect to @a image, writing the output into @a target.
+   *
+   *  The @a target must already have the final size, and can be a view into
+   *  a larger image. Returns @a false if the sizes don't match.
+   */
+  template <class T>
+  static bool render(const GenericImage<T>& image, GenericImage<T>& target,
+    const std::map<std::string, double>&, int);
+
+  /// The effect can write its output into a pre-sized target.
+  virtual bool can_render() const { return true; }
+  /// Apply the effect with the current properties, writing into @a target.
+  virtual bool render(const Image8& image, Image8& target, int verb)
+    { return render(image, target, get_properties(), verb); }
+  /// Apply the effect with the current properties, writing into @a target.
+  virtual bool render(const Image16& image, Image16& target, int verb)
+    { return render(image, target, get_properties(), verb); }
+
+  /** @brief Apply the effect to each plane of a planar image, at the plane's
+   *         own resolution.
+   *
+   *  This is used to crop and resize JPEG components without converting them
+   *  to RGB or upsampling the chroma. Each plane is resampled in one pass
+   *  from the crop region mapped to its own coordinates, taking into account
+   *  that the samples of subsampled planes are centered between those of the
+   *  full-resolution plane, so the planes stay aligned.
+   */
+  static void apply_planar(PlanarImage<unsigned char>& image,
+    const std::map<std::string, double>&, int);
+
+ private:
+  template <class T>
+  void apply_(GenericImage<T>&, int);
 };
 
 #endif
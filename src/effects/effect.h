@@ -0,0 +1,124 @@
+/** @file effect.h
+ *  @brief The interface shared by all effects.
+ */
+#ifndef LAPSE_EFFECT_H_
+#define LAPSE_EFFECT_H_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <stdint.h>
+
+#include "image/image.h"
+
+/// Map from property names to numbers.
+typedef std::map<std::string, double> PropertyMap;
+/// The names of the properties set for an effect.
+typedef std::set<std::string> PropertyNames;
+
+typedef GenericImage<unsigned char> Image8;
+typedef GenericImage<uint16_t> Image16;
+
+/// What an effect is told about the frames of a run before it starts.
+struct FrameGeometry {
+  /// Size of the frames, as they are loaded.
+  size_t  width, height;
+  /// Number of channels.
+  size_t  channels;
+};
+
+/** @brief Base class for effects.
+ *
+ *  An effect is used in three stages: @a prepare is called once per run,
+ *  @a update once per frame with the properties interpolated for that frame,
+ *  and then @a apply (or @a render) does the work. Effects keep whatever
+ *  they build from the properties (profiles, transforms, look-up tables,
+ *  remap tables) between frames, and only rebuild it when the properties
+ *  change, which is most of the time not the case between keyframes.
+ *
+ *  Effect objects are not thread-safe: each one should only be used by one
+ *  thread at a time.
+ */
+class Effect {
+ public:
+  Effect() : has_properties_(false) {}
+  virtual ~Effect() {}
+
+  /** @brief Prepare for a run.
+   *
+   *  @a properties are the names of all the properties set for the effect
+   *  in the run. The default does nothing.
+   */
+  virtual void prepare(const FrameGeometry&, const PropertyNames& properties)
+    { }
+
+  /** @brief Set the properties for the next frame.
+   *
+   *  Returns @a true if they are different from those of the previous frame,
+   *  in which case anything built from them is dropped.
+   */
+  bool update(const PropertyMap& props) {
+    if (has_properties_ && props == properties_)
+      return false;
+    properties_ = props;
+    has_properties_ = true;
+    properties_changed_();
+    return true;
+  }
+
+  /// Get the properties for the current frame.
+  const PropertyMap& get_properties() const { return properties_; }
+
+  /// Apply the effect to an 8-bit image, with the current properties.
+  virtual void apply(Image8&, int verb) = 0;
+  /// Apply the effect to a 16-bit image, with the current properties.
+  virtual void apply(Image16&, int verb) = 0;
+
+  /// Whether the effect implements @a render.
+  virtual bool can_render() const { return false; }
+
+  /** @brief Apply the effect to @a image, writing the output into @a target.
+   *
+   *  The @a target must already have the size of the output (see
+   *  @a EffectFactory::get_output_size), and can be a view into a larger
+   *  image. Returns @a false if this is not possible; by default, it never
+   *  is.
+   */
+  virtual bool render(const Image8& image, Image8& target, int verb)
+    { return false; }
+  /// Like the 8-bit @a render, for 16-bit images.
+  virtual bool render(const Image16& image, Image16& target, int verb)
+    { return false; }
+
+  /** @brief Prepare the output of the effect before its input is available.
+   *
+   *  This fills in the output @a canvas for an input of size @a w x @a h,
+   *  taking the channel types and metadata from @a like, and sets
+   *  @a interior to the view of the canvas where the input should be
+   *  written. Returns @a false if this is not possible; by default, it never
+   *  is.
+   */
+  virtual bool make_canvas(const Image8& like, size_t w, size_t h,
+      Image8& canvas, Image8& interior)
+    { return false; }
+  /// Like the 8-bit @a make_canvas, for 16-bit images.
+  virtual bool make_canvas(const Image16& like, size_t w, size_t h,
+      Image16& canvas, Image16& interior)
+    { return false; }
+
+  /// Update the properties and apply the effect, in one call.
+  template <class T>
+  void operator()(GenericImage<T>& image, const PropertyMap& props, int verb)
+    { update(props); apply(image, verb); }
+
+ protected:
+  /// Called when the properties change. The default does nothing.
+  virtual void properties_changed_() { }
+
+ private:
+  PropertyMap   properties_;
+  bool          has_properties_;
+};
+
+#endif
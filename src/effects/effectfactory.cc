@@ -3,23 +3,55 @@
 #include "effects/exposure.h"
 #include "effects/whitebalance.h"
 #include "effects/cropresize.h"
+#include "effects/lens.h"
 #include "effects/pad.h"
+#include "effects/transform.h"
 
 EffectFactory* EffectFactory::instance_ = 0;
 
 EffectFactory::EffectFactory()
 {
-  add_effect("exposure", ExposureEffect());
-  add_effect("whitebalance", WhiteBalanceEffect());
+  add_effect("exposure", ExposureEffect(), true);
+  add_effect("whitebalance", WhiteBalanceEffect(), true);
   add_effect("cropresize", CropResizeEffect());
   add_effect("pad", PadEffect());
+  add_effect("transform", TransformEffect());
+  add_effect("lens", LensEffect());
+
+  set_size_function("cropresize",
+    [](const PropertyMap& props, size_t w, size_t h) {
+      const CropResizeEffect::Geometry geom =
+        CropResizeEffect::get_geometry(props, w, h);
+      return std::make_pair(geom.width, geom.height);
+    });
+  set_size_function("pad", [](const PropertyMap& props, size_t, size_t)
+    { return PadEffect::get_size(props); });
+  set_size_function("transform", &TransformEffect::get_size);
+
+  set_layout("exposure", LAYOUT_ANY);
+}
+
+boost::shared_ptr<Effect> EffectFactory::make_effect(const std::string& name)
+  const
+{
+  auto i = makers_.find(name);
+  if (i == makers_.end())
+    throw std::runtime_error("EffectFactory: effect '" + name +
+      "' not found.");
+  return boost::shared_ptr<Effect>(i -> second());
+}
+
+std::pair<size_t, size_t> EffectFactory::get_output_size(
+  const std::string& name, const PropertyMap& props, size_t w, size_t h) const
+{
+  auto i = size_functions_.find(name);
+  if (i == size_functions_.end())
+    return std::make_pair(w, h);
+  return i -> second(props, w, h);
 }
 
-const EffectFactory::Transformation& EffectFactory::get_effect(
-  const std::string& name)
+ImageLayout EffectFactory::get_layout(const std::string& name) const
 {
-  auto i = transformations_.find(name);
-  if (i == transformations_.end())
-    throw std::runtime_error("EffectFactory: effect '" + name + "' not found.");
-  return i -> second;
+  auto i = layouts_.find(name);
+  return (i == layouts_.end())?LAYOUT_INTERLEAVED:i -> second;
 }
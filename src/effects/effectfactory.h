@@ -1,29 +1,35 @@
 /** @file effectfactory.h
- *  @brief Defines a class that can return effect functions based on a string
- *         name.
+ *  @brief Defines a class that can make effects based on a string name.
  */
 #ifndef LAPSE_EFFECTFACTORY_H_
 #define LAPSE_EFFECTFACTORY_H_
 
 #include <string>
 #include <map>
+#include <set>
 #include <functional>
+#include <stdexcept>
+#include <utility>
 
-#include "image/image.h"
-
-/// Map from property names to numbers.
-typedef std::map<std::string, double> PropertyMap;
+#include <boost/shared_ptr.hpp>
 
-typedef GenericImage<unsigned char> Image8;
+#include "effects/effect.h"
+#include "image/image.h"
 
-/// A singleton class keeping track of all the effects.
+/** @brief A singleton class keeping track of all the effects.
+ *
+ *  Each effect is registered with a prototype, and @a make_effect returns
+ *  fresh copies of it. Effects keep state from one frame to the next (see
+ *  @a Effect), so every user that applies an effect to a sequence of frames
+ *  should make its own instance, and keep it for the whole sequence.
+ */
 class EffectFactory {
  public:
-  /// A transformation function.
-  typedef std::function<void(Image8&, const PropertyMap&, int)>
-    Transformation;
-  /// Transformations with their names.
-  typedef std::map<std::string, Transformation> Transformations;
+  /// A function returning the output size of an effect given the input size.
+  typedef std::function<std::pair<size_t, size_t>(const PropertyMap&, size_t,
+    size_t)> SizeFunction;
+  /// A function making a new instance of an effect.
+  typedef std::function<Effect*()> Maker;
 
   /// Get the singleton instance.
   static EffectFactory* get_instance() {
@@ -31,18 +37,58 @@ class EffectFactory {
     return instance_;
   }
 
-  /// Add a transformation.
-  void add_effect(const std::string& name, const Transformation& trafo)
-    { transformations_[name] = trafo; }
+  /** @brief Add an effect.
+   *
+   *  The instances returned by @a make_effect are copies of @a prototype.
+   *  Set @a pointwise to @a true if the output value of each pixel depends
+   *  only on the input value of the same pixel (and on the metadata). Such
+   *  effects commute with cropping, which allows the crops to be moved
+   *  ahead of them.
+   */
+  template <class E>
+  void add_effect(const std::string& name, const E& prototype,
+      bool pointwise = false) {
+    makers_[name] = [prototype]() -> Effect* { return new E(prototype); };
+    if (pointwise) pointwise_.insert(name);
+    else pointwise_.erase(name);
+  }
+
+  /// Make a new instance of an effect.
+  boost::shared_ptr<Effect> make_effect(const std::string& name) const;
+
+  /// Check whether an effect acts on each pixel independently.
+  bool is_pointwise(const std::string& name) const
+    { return pointwise_.count(name) > 0; }
+
+  /** @brief Set the function returning the output size of an effect.
+   *
+   *  Effects without one are assumed to keep the size of the image.
+   */
+  void set_size_function(const std::string& name, const SizeFunction& f)
+    { size_functions_[name] = f; }
+  /// Get the size of the output of an effect for an input of size @a w x @a h.
+  std::pair<size_t, size_t> get_output_size(const std::string& name,
+    const PropertyMap& props, size_t w, size_t h) const;
 
-  /// Get a transformation.
-  const Transformation& get_effect(const std::string& name);
+  /** @brief Set the pixel layout an effect works with.
+   *
+   *  The processor converts the image to this layout before applying the
+   *  effect. Use @a LAYOUT_ANY for effects that handle both layouts, to avoid
+   *  the conversion. Effects without a declared layout get interleaved images.
+   */
+  void set_layout(const std::string& name, ImageLayout layout)
+    { layouts_[name] = layout; }
+  /// Get the pixel layout an effect works with.
+  ImageLayout get_layout(const std::string& name) const;
 
  private:
   EffectFactory();
 
   static EffectFactory*     instance_;
-  Transformations           transformations_;
+  std::map<std::string, Maker>          makers_;
+  std::set<std::string>                 pointwise_;
+  std::map<std::string, SizeFunction>   size_functions_;
+  std::map<std::string, ImageLayout>    layouts_;
 };
 
 #endif
@@ -1,14 +1,19 @@
 #include "exposure.h"
 
 #include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <vector>
 
 #include <cmath>
 
 #include "color/profilefactory.h"
+#include "color/srgb.h"
 #include "color/transformfactory.h"
 #include "image/image-impl.h"
+#include "image/quantize.h"
 #include "exifprops/exifprops.h"
+#include "misc/cpudispatch.h"
 
 typedef GenericImage<float> Image32;
 
@@ -26,12 +31,16 @@ typename Container::mapped_type get_item(const Container& container,
 
 } // anonymous namespace
 
-void ExposureEffect::operator()(Image8& image,
-    const std::map<std::string, double>& props, int verb)
+template <class T>
+void ExposureEffect::apply_(GenericImage<T>& image, int verb)
 {
+  const PropertyMap& props = get_properties();
   if (props.count("use_xyz") > 0) {
     use_xyz_ = get_item(props, "use_xyz") >= 0.5;
   }
+  if (props.count("dither") > 0) {
+    dither_ = get_item(props, "dither") >= 0.5;
+  }
   if (props.count("ev100") > 0) {
     // setting the exposure in absolute units
     // we have to first calculate the exposure for the image
@@ -42,31 +51,247 @@ void ExposureEffect::operator()(Image8& image,
       std::cout << "current EV100=" << image_ev100 << " -> " << target_ev100
                 << "   ";
     }
-    multiply_exposure(image, image_ev100 - target_ev100, verb, use_xyz_);
+    multiply_exposure(image, image_ev100 - target_ev100, verb, use_xyz_,
+      dither_);
   } else if (props.count("evrel") > 0) {
     const double evrel = get_item(props, "evrel");
     if (verb >= 2) {
       std::cout << "exposure   ";
     }
-    multiply_exposure(image, evrel, verb, use_xyz_);
+    multiply_exposure(image, evrel, verb, use_xyz_, dither_);
   };
 }
 
 namespace {
 
+// multiply n contiguous values by factor, rounding and clamping the results
+template <class T>
+inline void multiply_values(T* data, size_t n, float factor)
+{
+  for (size_t i = 0; i < n; ++i)
+    data[i] = quantize<T>(data[i]*factor);
+}
+
+template <class T>
+LAPSE_TARGET_AVX2 void multiply_values_avx2(T* data, size_t n, float factor)
+{
+  multiply_values(data, n, factor);
+}
+
+template <class T>
+LAPSE_TARGET_AVX512 void multiply_values_avx512(T* data, size_t n,
+    float factor)
+{
+  multiply_values(data, n, factor);
+}
+
+// the version of multiply_values to use on this CPU
+template <class T>
+void multiply_values_dispatch(T* data, size_t n, float factor)
+{
+  typedef void (*Kernel)(T*, size_t, float);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &multiply_values<T>, &multiply_values_avx2<T>, &multiply_values_avx512<T>);
+  kernel(data, n, factor);
+}
+
+// multiply the pixels in a row with arbitrary strides; N is the number of
+// channels, or 0 to read it from the row
+template <size_t N, class T>
+void multiply_pixels(const RowIterator<T>& row, float factor)
+{
+  const size_t width = row.getWidth();
+  const size_t ncomps = (N > 0)?N:row.getChannelCount();
+  const int cstride = row.getChannelStride();
+  for (size_t x = 0; x < width; ++x) {
+    T* p = row(x);
+    for (size_t k = 0; k < ncomps; ++k)
+      p[k*cstride] = quantize<T>(p[k*cstride]*factor);
+  }
+}
+
+template <class T>
+void multiply_image(GenericImage<T>& image, float factor)
+{
+  const size_t width = image.getWidth();
+  const size_t ncomps = image.getChannelCount();
+  for (auto row = image.rowBegin(); row != image.rowEnd(); ++row) {
+    if (row.isContiguous()) {
+      multiply_values_dispatch(row.getData(), width*ncomps, factor);
+    } else if (row.getPixelStride() == 1) {
+      // planar image: each channel is contiguous
+      for (size_t k = 0; k < ncomps; ++k)
+        multiply_values_dispatch(row.channel(k), width, factor);
+    } else {
+      switch (ncomps) {
+        case 1: multiply_pixels<1>(row, factor); break;
+        case 3: multiply_pixels<3>(row, factor); break;
+        case 4: multiply_pixels<4>(row, factor); break;
+        default: multiply_pixels<0>(row, factor);
+      }
+    }
+  }
+}
+
+// replace n contiguous values by their entries in a 256-entry table
 template <class T>
-void multiply_image(GenericImage<T>& image, double factor)
+inline void map_values(T* data, size_t n, const T* table)
 {
-  typename GenericImage<T>::value_type* data = image.getData();
-  const size_t n = image.getSize();
   for (size_t i = 0; i < n; ++i)
-    data[i] = GenericImage<T>::clampColor((double)data[i]*factor);
+    data[i] = table[data[i]];
+}
+
+template <class T>
+LAPSE_TARGET_AVX2 void map_values_avx2(T* data, size_t n, const T* table)
+{
+  map_values(data, n, table);
+}
+
+template <class T>
+LAPSE_TARGET_AVX512 void map_values_avx512(T* data, size_t n, const T* table)
+{
+  map_values(data, n, table);
+}
+
+// map the values of an integer image through a table with an entry for
+// every value
+template <class T>
+void map_image(GenericImage<T>& image, const T* table)
+{
+  typedef void (*Kernel)(T*, size_t, const T*);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &map_values<T>, &map_values_avx2<T>, &map_values_avx512<T>);
+
+  const size_t width = image.getWidth();
+  const size_t ncomps = image.getChannelCount();
+  for (auto row = image.rowBegin(); row != image.rowEnd(); ++row) {
+    if (row.isContiguous()) {
+      kernel(row.getData(), width*ncomps, table);
+    } else if (row.getPixelStride() == 1) {
+      for (size_t k = 0; k < ncomps; ++k)
+        kernel(row.channel(k), width, table);
+    } else {
+      const int cstride = row.getChannelStride();
+      for (size_t x = 0; x < width; ++x) {
+        T* p = row(x);
+        for (size_t k = 0; k < ncomps; ++k)
+          p[k*cstride] = table[p[k*cstride]];
+      }
+    }
+  }
+}
+
+// map the values of an 8-bit image through a 256-entry table of unrounded
+// values, quantizing with ordered dithering
+void map_image_dithered(Image8& image, const float* table)
+{
+  const size_t width = image.getWidth();
+  const size_t ncomps = image.getChannelCount();
+  std::vector<float> buffer(width*ncomps);
+  size_t y = 0;
+  for (auto row = image.rowBegin(); row != image.rowEnd(); ++row, ++y) {
+    if (row.isContiguous()) {
+      Image8::value_type* data = row.getData();
+      for (size_t i = 0; i < width*ncomps; ++i)
+        buffer[i] = table[data[i]];
+      quantizeRowDithered(&buffer[0], width, ncomps, data, 0, y);
+    } else if (row.getPixelStride() == 1) {
+      for (size_t k = 0; k < ncomps; ++k) {
+        Image8::value_type* data = row.channel(k);
+        for (size_t x = 0; x < width; ++x)
+          buffer[x] = table[data[x]];
+        quantizeRowDithered(&buffer[0], width, 1, data, 0, y);
+      }
+    } else {
+      const int cstride = row.getChannelStride();
+      for (size_t x = 0; x < width; ++x) {
+        Image8::value_type* p = row(x);
+        const float d = ditherOffset(x, y);
+        for (size_t k = 0; k < ncomps; ++k)
+          p[k*cstride] = quantize<Image8::value_type>(
+            table[p[k*cstride]] + d);
+      }
+    }
+  }
+}
+
+// fill in the 256-entry table of unrounded values for the exposure change
+// of an 8-bit image with dithering; these are the same tables as for the
+// undithered change, but keep the fractional parts of the results
+void make_dither_table(double factor, bool xyz, float* table)
+{
+  if (xyz) {
+    makeSrgbScaleTable(factor, table);
+  } else {
+    for (unsigned i = 0; i < 256; ++i)
+      table[i] = i*(float)factor;
+  }
 }
 
 } // anonymous namespace
 
-void ExposureEffect::multiply_exposure(Image8& image8, double ev, int verb,
+template <>
+const std::vector<unsigned char>& ExposureEffect::get_table_(double factor)
+{
+  if (table8_.empty() || factor != table8_factor_) {
+    table8_.resize(256);
+    makeSrgbScaleTable(factor, &table8_[0]);
+    table8_factor_ = factor;
+  }
+  return table8_;
+}
+
+template <>
+const std::vector<uint16_t>& ExposureEffect::get_table_(double factor)
+{
+  if (table16_.empty() || factor != table16_factor_) {
+    table16_.resize(65536);
+    makeSrgbScaleTable(factor, &table16_[0]);
+    table16_factor_ = factor;
+  }
+  return table16_;
+}
+
+ColorTransformCache& ExposureEffect::to_xyz_()
+{
+  if (!to_xyz_cache_) {
+    to_xyz_cache_.reset(new ColorTransformCache(
+      ColorProfileFactory::fromBuiltin("sRGB"),
+      ColorProfileFactory::fromBuiltin("XYZ")));
+  }
+  return *to_xyz_cache_;
+}
+
+ColorTransformCache& ExposureEffect::from_xyz_()
+{
+  if (!from_xyz_cache_) {
+    from_xyz_cache_.reset(new ColorTransformCache(
+      ColorProfileFactory::fromBuiltin("XYZ"),
+      ColorProfileFactory::fromBuiltin("sRGB")));
+  }
+  return *from_xyz_cache_;
+}
+
+bool ExposureEffect::multiply_dithered_(Image8& image8, double factor,
     bool xyz)
+{
+  if (xyz && image8.getChannelCount() != 3)
+    return false;
+
+  if (dither_table_.empty() || factor != dither_factor_ ||
+      xyz != dither_xyz_) {
+    dither_table_.resize(256);
+    make_dither_table(factor, xyz, &dither_table_[0]);
+    dither_factor_ = factor;
+    dither_xyz_ = xyz;
+  }
+  map_image_dithered(image8, &dither_table_[0]);
+  return true;
+}
+
+template <class T>
+void ExposureEffect::multiply_exposure(GenericImage<T>& image, double ev,
+    int verb, bool xyz, bool dither)
 {
   const double factor = std::pow(2, ev);
 
@@ -75,30 +300,37 @@ void ExposureEffect::multiply_exposure(Image8& image8, double ev, int verb,
               << std::endl;
   }
 
-  if (xyz) {
-    ColorProfile sRGB = ColorProfileFactory::fromBuiltin("sRGB");
-    ColorProfile XYZ = ColorProfileFactory::fromBuiltin("XYZ");
+  if (dither && multiply_dithered_(image, factor, xyz))
+    return;
 
+  if (xyz && image.getChannelCount() == 3) {
+    // XYZ is a linear function of linear RGB, so multiplying in XYZ is the
+    // same as multiplying each linear RGB channel; the round trip through
+    // XYZ comes down to one table for all the values
+    map_image(image, &get_table_<T>(factor)[0]);
+  } else if (xyz) {
     // convert the image to XYZ first
     Image32 image32;
-    image32.reshape(image8.getWidth(), image8.getHeight());
+    image32.reshape(image.getWidth(), image.getHeight());
     image32.setChannelCount(3);
     image32.setChannelTypes("XYZ");
     image32.allocate();
 
-    ColorTransform transform = ColorTransformFactory::fromProfiles(
-      sRGB, image8, XYZ, image32, INTENT_PERCEPTUAL);
-    transform.apply(image8.getData(), image32.getData(),
-      image8.getWidth()*image8.getHeight());
+    to_xyz_().get(image, image32).apply(image, image32);
 
     multiply_image(image32, factor);
 
     // convert back to sRGB
-    ColorTransform transform_back = ColorTransformFactory::fromProfiles(
-      XYZ, image32, sRGB, image8, INTENT_PERCEPTUAL);
-    transform_back.apply(image32.getData(), image8.getData(),
-      image8.getWidth()*image8.getHeight());
+    from_xyz_().get(image32, image).apply(image32, image);
   } else {
-    multiply_image(image8, factor);
+    multiply_image(image, factor);
   }
 }
+
+// the pixel types the processor works with
+template void ExposureEffect::apply_(Image8&, int);
+template void ExposureEffect::apply_(Image16&, int);
+template void ExposureEffect::multiply_exposure(Image8&, double, int, bool,
+  bool);
+template void ExposureEffect::multiply_exposure(Image16&, double, int, bool,
+  bool);
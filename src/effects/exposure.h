@@ -6,22 +6,36 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
-#include "image/image.h"
+#include <boost/shared_ptr.hpp>
+
+#include <stdint.h>
 
-typedef GenericImage<unsigned char> Image8;
+#include "color/transformcache.h"
+#include "effects/effect.h"
+#include "image/image.h"
 
-/// Apply an exposure effect.
-class ExposureEffect {
+/** @brief Apply an exposure effect.
+ *
+ *  The look-up tables for the exposure change are kept from one frame to
+ *  the next, and only rebuilt when the factor (or, for the dithering
+ *  table, the color space) changes; so are the color transforms used for
+ *  images that are not RGB.
+ */
+class ExposureEffect : public Effect {
  public:
-  ExposureEffect() : use_xyz_(true) {}
+  ExposureEffect() : use_xyz_(true), dither_(false), table8_factor_(0),
+    table16_factor_(0), dither_factor_(0), dither_xyz_(false) {}
 
   /** @brief Set whether to do the exposure change in CIE XYZ color space.
    *
-   *  The transformation in CIE XYZ is slower, but it's more accurate. There
-   *  are still inaccuracies coming from all the non-linear effects that
-   *  digital cameras commonly apply to their JPEGs, but this should be
-   *  better than performing the change in sRGB.
+   *  The transformation in CIE XYZ is more accurate. There are still
+   *  inaccuracies coming from all the non-linear effects that digital
+   *  cameras commonly apply to their JPEGs, but this should be better than
+   *  performing the change in sRGB. For RGB images, it is done with a
+   *  look-up table that gives the same result as converting to XYZ and back,
+   *  so it is as fast as the change in sRGB; other images are converted.
    */
   void set_use_xyz(bool b) { use_xyz_ = b; }
   /** @brief Get whether we do the exposure change in CIE XYZ color space.
@@ -30,13 +44,62 @@ class ExposureEffect {
    */
   bool get_use_xyz() const { return use_xyz_; }
 
-  /// Apply exposure effect with the given properties.
-  void operator()(Image8&, const std::map<std::string, double>&, int);
+  /** @brief Set whether to use ordered dithering when rounding the results.
+   *
+   *  Raising the exposure spreads the 8-bit levels apart, which can show as
+   *  bands in smooth gradients such as skies; dithering breaks them up.
+   *  This is done for RGB images, or when not working in CIE XYZ. Images
+   *  processed at 16 bits are dithered instead when they are rounded to 8
+   *  bits for writing, since that is where the bands appear.
+   */
+  void set_dither(bool b) { dither_ = b; }
+  /** @brief Get whether we use dithering.
+   *
+   *  @see set_dither.
+   */
+  bool get_dither() const { return dither_; }
+
+  /// Apply the exposure effect with the current properties.
+  virtual void apply(Image8& image, int verb) { apply_(image, verb); }
+  /// Apply the exposure effect with the current properties.
+  virtual void apply(Image16& image, int verb) { apply_(image, verb); }
+
   /// Increase exposure by @a ev stops.
-  void multiply_exposure(Image8&, double ev, int, bool);
+  template <class T>
+  void multiply_exposure(GenericImage<T>&, double ev, int, bool,
+    bool dither = false);
 
  private:
+  template <class T>
+  void apply_(GenericImage<T>&, int);
+  // the table mapping each value to its exposed value, for pixel type T,
+  // rebuilt only if the factor changed
+  template <class T>
+  const std::vector<T>& get_table_(double factor);
+  // multiply the exposure of an 8-bit image by factor, with dithering;
+  // returns false if this can't be done
+  bool multiply_dithered_(Image8&, double factor, bool xyz);
+  // 16-bit images are only rounded to 8 bits when they are written, so they
+  // are dithered then instead (see Processor::run)
+  template <class T>
+  bool multiply_dithered_(GenericImage<T>&, double, bool) { return false; }
+  // the transforms to XYZ and back
+  ColorTransformCache& to_xyz_();
+  ColorTransformCache& from_xyz_();
+
   bool    use_xyz_;
+  bool    dither_;
+
+  std::vector<unsigned char>    table8_;
+  double                        table8_factor_;
+  std::vector<uint16_t>         table16_;
+  double                        table16_factor_;
+  std::vector<float>            dither_table_;
+  double                        dither_factor_;
+  /// Whether the dithering table is for a change in XYZ.
+  bool                          dither_xyz_;
+  boost::shared_ptr<ColorTransformCache>    to_xyz_cache_;
+  boost::shared_ptr<ColorTransformCache>    from_xyz_cache_;
 };
 
 #endif
@@ -0,0 +1,184 @@
+#include "lens.h"
+
+#include <cmath>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "misc/threadpool.h"
+#include "transforms/remapper-impl.h"
+
+namespace {
+
+template <class Key, class Container>
+typename Container::mapped_type get_item_default(const Container& container,
+    const Key& key, typename Container::mapped_type def_value)
+{
+  typename Container::const_iterator i = container.find(key);
+  if (i == container.end())
+    return def_value;
+  else
+    return i -> second;
+}
+
+typedef boost::shared_ptr<const RemapTable> TablePtr;
+
+// the image size followed by the parameters of the model
+typedef std::vector<double> CacheKey;
+
+// number of tables kept; more than one helps when frames of different sizes
+// are mixed
+const size_t cache_size = 4;
+
+// most recently used tables first
+std::list<std::pair<CacheKey, TablePtr> > cache;
+boost::mutex cache_mutex;
+
+TablePtr make_table(const CacheKey& key)
+{
+  const size_t w = key[0];
+  const size_t h = key[1];
+  const double k1 = key[2], k2 = key[3], k3 = key[4];
+  const double v1 = key[5], v2 = key[6], v3 = key[7];
+  const double zoom = key[8];
+  const bool vignetting = (v1 != 0 || v2 != 0 || v3 != 0);
+
+  // positions are those of pixel centers
+  const double cx = (w - 1)/2.0;
+  const double cy = (h - 1)/2.0;
+  const double radius = std::sqrt((double)w*w + (double)h*h)/2;
+
+  boost::shared_ptr<RemapTable> table(new RemapTable(w, h, w, h));
+  // allocate the gains before the rows are filled in parallel
+  if (vignetting)
+    table -> setGain(0, 0, 1);
+  ThreadPool::getInstance().parallelFor(h, [&](size_t j1, size_t j2) {
+    for (size_t j = j1; j < j2; ++j) {
+      const double v = (j - cy)/radius/zoom;
+      for (size_t i = 0; i < w; ++i) {
+        const double u = (i - cx)/radius/zoom;
+        const double r2 = u*u + v*v;
+        const double factor = 1 + r2*(k1 + r2*(k2 + r2*k3));
+        table -> set(i, j, cx + u*factor*radius, cy + v*factor*radius);
+        if (vignetting) {
+          const double s2 = r2*factor*factor;
+          const double falloff = 1 + s2*(v1 + s2*(v2 + s2*v3));
+          table -> setGain(i, j, (falloff > 0)?1/falloff:65535);
+        }
+      }
+    }
+  }, 16);
+
+  return table;
+}
+
+} // anonymous namespace
+
+TablePtr LensEffect::get_table(const std::map<std::string, double>& props,
+    size_t w, size_t h)
+{
+  const double zoom = get_item_default(props, "zoom", 1);
+  if (zoom <= 0)
+    throw std::runtime_error("[LensEffect] Zoom should be positive.");
+  const CacheKey key{(double)w, (double)h,
+    get_item_default(props, "k1", 0), get_item_default(props, "k2", 0),
+    get_item_default(props, "k3", 0), get_item_default(props, "v1", 0),
+    get_item_default(props, "v2", 0), get_item_default(props, "v3", 0),
+    zoom};
+
+  // look the table up, moving it to the front if it's there
+  auto find = [&key]() {
+    for (auto i = cache.begin(); i != cache.end(); ++i) {
+      if (i -> first == key) {
+        cache.splice(cache.begin(), cache, i);
+        return true;
+      }
+    }
+    return false;
+  };
+
+  boost::unique_lock<boost::mutex> lock(cache_mutex);
+  if (find())
+    return cache.front().second;
+
+  // the table is built in parallel, which can take a while, so other
+  // threads may use the cache meanwhile; if one of them builds the same
+  // table, its copy is kept and this one is dropped
+  lock.unlock();
+  TablePtr table = make_table(key);
+  lock.lock();
+  if (find())
+    return cache.front().second;
+
+  cache.push_front(std::make_pair(key, table));
+  if (cache.size() > cache_size)
+    cache.pop_back();
+  return table;
+}
+
+template <class T>
+bool LensEffect::render(const GenericImage<T>& image,
+    GenericImage<T>& target, const std::map<std::string, double>& props,
+    int verb)
+{
+  if (image.getWidth() != target.getWidth() ||
+      image.getHeight() != target.getHeight())
+    return false;
+
+  if (verb >= 2)
+    std::cout << "Correcting lens distortion and vignetting" << std::endl;
+  get_table(props, image.getWidth(), image.getHeight()) -> apply(image,
+    target);
+
+  return true;
+}
+
+template <class T>
+bool LensEffect::render_(const GenericImage<T>& image,
+    GenericImage<T>& target, int verb)
+{
+  if (image.getWidth() != target.getWidth() ||
+      image.getHeight() != target.getHeight())
+    return false;
+
+  if (verb >= 2)
+    std::cout << "Correcting lens distortion and vignetting" << std::endl;
+  // the shared cache has to be locked, so only go there when the
+  // properties or the frame size changed
+  if (!table_ || table_ -> getSourceWidth() != image.getWidth() ||
+      table_ -> getSourceHeight() != image.getHeight())
+    table_ = get_table(get_properties(), image.getWidth(), image.getHeight());
+  table_ -> apply(image, target);
+
+  return true;
+}
+
+template <class T>
+void LensEffect::apply_(GenericImage<T>& image, int verb)
+{
+  GenericImage<T> result;
+  result.reshape(image.getWidth(), image.getHeight());
+  result.setChannelCount(image.getChannelCount());
+  result.allocate();
+  render_(image, result, verb);
+  result.copyMetadataFrom(image);
+  // (setting the channel types also sets the channel count)
+  if (!image.getChannelTypes().empty())
+    result.setChannelTypes(image.getChannelTypes());
+  image = result;
+}
+
+// the pixel types the processor works with
+template bool LensEffect::render(const Image8&, Image8&,
+  const std::map<std::string, double>&, int);
+template bool LensEffect::render(const Image16&, Image16&,
+  const std::map<std::string, double>&, int);
+template void LensEffect::apply_(Image8&, int);
+template void LensEffect::apply_(Image16&, int);
+template bool LensEffect::render_(const Image8&, Image8&, int);
+template bool LensEffect::render_(const Image16&, Image16&, int);
@@ -0,0 +1,82 @@
+/** @file lens.h
+ *  @brief An effect that corrects lens distortion and vignetting.
+ */
+#ifndef LAPSE_LENS_H_
+#define LAPSE_LENS_H_
+
+#include <map>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <stdint.h>
+
+#include "effects/effect.h"
+#include "image/image.h"
+#include "transforms/remapper.h"
+
+/** @brief Correct radial lens distortion and vignetting.
+ *
+ *  Distances from the center of the image are measured in units of half its
+ *  diagonal. A point at distance @a r in the corrected image comes from
+ *  distance r*(1 + k1*r^2 + k2*r^4 + k3*r^6) in the original, so a positive
+ *  @a k1 corrects pincushion distortion, and a negative one corrects barrel
+ *  distortion. A @a zoom larger than 1 enlarges the corrected image, to crop
+ *  away the edges left uncovered.
+ *
+ *  Vignetting is modeled as a brightness falloff by a factor of
+ *  1 + v1*r^2 + v2*r^4 + v3*r^6 at distance @a r in the original image, so
+ *  it is corrected with negative values.
+ *
+ *  The map from each output pixel to its source, and the gain for each
+ *  pixel, are calculated once for each image size and set of properties, and
+ *  kept in a cache shared by all instances; each instance also holds on to
+ *  the table for its current properties, so when they don't change from one
+ *  frame to the next, applying the effect is a single pass over the image.
+ */
+class LensEffect : public Effect {
+ public:
+  /// Apply the effect with the current properties.
+  virtual void apply(Image8& image, int verb) { apply_(image, verb); }
+  /// Apply the effect with the current properties.
+  virtual void apply(Image16& image, int verb) { apply_(image, verb); }
+
+  /// The effect can write its output into a pre-sized target.
+  virtual bool can_render() const { return true; }
+  /// Apply the effect with the current properties, writing into @a target.
+  virtual bool render(const Image8& image, Image8& target, int verb)
+    { return render_(image, target, verb); }
+  /// Apply the effect with the current properties, writing into @a target.
+  virtual bool render(const Image16& image, Image16& target, int verb)
+    { return render_(image, target, verb); }
+
+  /** @brief Apply the effect to @a image, writing the output into @a target.
+   *
+   *  The @a target must have the same size as the image, and can be a view
+   *  into a larger image. Returns @a false if the sizes don't match.
+   */
+  template <class T>
+  static bool render(const GenericImage<T>& image, GenericImage<T>& target,
+    const std::map<std::string, double>&, int);
+
+  /** @brief Get the remap table for an image of size @a w x @a h.
+   *
+   *  This is taken from the cache if possible.
+   */
+  static boost::shared_ptr<const RemapTable> get_table(
+    const std::map<std::string, double>&, size_t w, size_t h);
+
+ protected:
+  virtual void properties_changed_() { table_.reset(); }
+
+ private:
+  template <class T>
+  void apply_(GenericImage<T>&, int);
+  template <class T>
+  bool render_(const GenericImage<T>&, GenericImage<T>&, int);
+
+  /// The table for the current properties, if it was needed yet.
+  boost::shared_ptr<const RemapTable>   table_;
+};
+
+#endif
@@ -1,9 +1,14 @@
 #include "pad.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
+#include <cstring>
+
 #include "image/image-impl.h"
+#include "image/quantize.h"
 
 namespace {
 
@@ -28,54 +33,117 @@ typename Container::mapped_type get_item_default(const Container& container,
     return i -> second;
 }
 
+// fill @a n pixels starting at @a p with the given color
+template <class T>
+void fill_pixels(T* p, size_t n, const T* color, size_t ncomps)
+{
+  if (n == 0)
+    return;
+
+  bool uniform = true;
+  for (size_t k = 1; k < ncomps; ++k)
+    if (color[k] != color[0]) uniform = false;
+  if (uniform) {
+    std::fill(p, p + n*ncomps, color[0]);
+    return;
+  }
+
+  // write one pixel, then keep doubling the filled part
+  std::copy(color, color + ncomps, p);
+  const size_t total = n*ncomps;
+  for (size_t done = ncomps; done < total; ) {
+    const size_t chunk = std::min(done, total - done);
+    std::memcpy(p + done, p, chunk*sizeof(T));
+    done += chunk;
+  }
+}
+
 } // anonymous namespace
 
-void PadEffect::operator()(Image8& image,
-    const std::map<std::string, double>& props, int verb)
+std::pair<size_t, size_t> PadEffect::get_size(
+    const std::map<std::string, double>& props)
 {
-  // get the target image size
-  size_t im_w = get_item(props, "target_w");
-  size_t im_h = get_item(props, "target_h");
-
-  // get the background color, or assume black
-  double bkg_r = get_item_default(props, "bkg_r", 0);
-  double bkg_g = get_item_default(props, "bkg_g", 0);
-  double bkg_b = get_item_default(props, "bkg_b", 0);
+  return std::make_pair(size_t(get_item(props, "target_w")),
+    size_t(get_item(props, "target_h")));
+}
 
-  // make an image of the target size and fill it with the background color
-  Image8 result;
-  result.reshape(im_w, im_h);
-  result.setChannelTypes(image.getChannelTypes());
-  result.allocate();
-  result.copyMetadataFrom(image);
+template <class T>
+bool PadEffect::make_canvas(const std::map<std::string, double>& props,
+    const GenericImage<T>& like, size_t w, size_t h, GenericImage<T>& canvas,
+    GenericImage<T>& interior)
+{
+  // get the target image size
+  const std::pair<size_t, size_t> size = get_size(props);
+  const size_t im_w = size.first;
+  const size_t im_h = size.second;
+  if (w > im_w || h > im_h)
+    return false;
 
   // XXX from here on assuming channel count is 3 and order is RGB
-  if (result.getChannelCount() != 3)
+  if (like.getChannelCount() != 3)
     throw std::runtime_error("Padding assumes RGB images.");
 
-  // position image in center of resulting frame
-  // crop if necessary
-  int start_x = ((int)im_w - image.getWidth())/2;
-  int start_y = ((int)im_h - image.getHeight())/2;
-  int end_x = ((int)im_w + image.getWidth())/2;
-  int end_y = ((int)im_h + image.getHeight())/2;
-
-  // fill with background color or image, depending on location
-  for (size_t i = 0; i < im_w; ++i) {
-    for (size_t j = 0; j < im_h; ++j) {
-      if (i < start_x || i >= end_x || j < start_y || j >= end_y) {
-        // background
-        result(i, j)[0] = result.clampColor(bkg_r);
-        result(i, j)[1] = result.clampColor(bkg_g);
-        result(i, j)[2] = result.clampColor(bkg_b);
-      } else {
-        // image
-        for (size_t k = 0; k < 3; ++k) {
-          result(i, j)[k] = image(i - start_x, j - start_y)[k];
-        }
-      }
-    }
+  // get the background color, or assume black; the color is given in 8-bit
+  // units whatever the pixel type
+  const double scale = std::numeric_limits<T>::max()/255.0;
+  const T bkg[3] = {
+    quantize<T>(get_item_default(props, "bkg_r", 0)*scale),
+    quantize<T>(get_item_default(props, "bkg_g", 0)*scale),
+    quantize<T>(get_item_default(props, "bkg_b", 0)*scale)};
+
+  // make an image of the target size
+  canvas = GenericImage<T>();
+  canvas.reshape(im_w, im_h);
+  canvas.setChannelTypes(like.getChannelTypes());
+  canvas.allocate();
+  canvas.copyMetadataFrom(like);
+
+  // position image in center of resulting frame, and fill only the border
+  // with the background color; the canvas is freshly allocated, so the rows
+  // above and below the image are contiguous
+  const size_t x0 = (im_w - w)/2;
+  const size_t y0 = (im_h - h)/2;
+  fill_pixels(canvas(0, 0), y0*im_w, bkg, 3);
+  fill_pixels(canvas(0, y0 + h), (im_h - y0 - h)*im_w, bkg, 3);
+  for (size_t j = y0; j < y0 + h; ++j) {
+    fill_pixels(canvas(0, j), x0, bkg, 3);
+    fill_pixels(canvas(x0 + w, j), im_w - x0 - w, bkg, 3);
   }
 
+  if (w > 0 && h > 0)
+    interior = canvas.cropped(x0, y0, w, h);
+  else
+    interior = GenericImage<T>();
+
+  return true;
+}
+
+template <class T>
+void PadEffect::apply_(GenericImage<T>& image, int verb)
+{
+  const PropertyMap& props = get_properties();
+  // get the target image size
+  const std::pair<size_t, size_t> size = get_size(props);
+
+  // crop the image if it's larger than the target size
+  GenericImage<T> source(image);
+  const size_t w = std::min(source.getWidth(), size.first);
+  const size_t h = std::min(source.getHeight(), size.second);
+  if (w != source.getWidth() || h != source.getHeight())
+    source.crop((source.getWidth() - w)/2, (source.getHeight() - h)/2, w, h);
+
+  GenericImage<T> result, interior;
+  make_canvas(props, source, w, h, result, interior);
+  if (!interior.isEmpty(GenericImage<T>::SEL_IMAGE))
+    interior.copyPixelsFrom(source);
+
   image = result;
 }
+
+// the pixel types the processor works with
+template void PadEffect::apply_(Image8&, int);
+template void PadEffect::apply_(Image16&, int);
+template bool PadEffect::make_canvas(const std::map<std::string, double>&,
+  const Image8&, size_t, size_t, Image8&, Image8&);
+template bool PadEffect::make_canvas(const std::map<std::string, double>&,
+  const Image16&, size_t, size_t, Image16&, Image16&);
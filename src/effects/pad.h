@@ -4,15 +4,53 @@
 #ifndef LAPSE_PAD_H_
 #define LAPSE_PAD_H_
 
-#include "image/image.h"
+#include <map>
+#include <string>
+#include <utility>
+
+#include <stdint.h>
 
-typedef GenericImage<unsigned char> Image8;
+#include "effects/effect.h"
+#include "image/image.h"
 
 /// Apply padding to an image.
-class PadEffect {
+class PadEffect : public Effect {
  public:
-  /// Apply the effect with the properties given.
-  void operator()(Image8&, const std::map<std::string, double>&, int);
+  /// Apply the effect with the current properties.
+  virtual void apply(Image8& image, int verb) { apply_(image, verb); }
+  /// Apply the effect with the current properties.
+  virtual void apply(Image16& image, int verb) { apply_(image, verb); }
+
+  /// Get the size of the padded image.
+  static std::pair<size_t, size_t> get_size(
+    const std::map<std::string, double>&);
+
+  /** @brief Prepare the padded frame for an image of size @a w x @a h,
+   *         before the image itself is available.
+   *
+   *  This allocates @a canvas at the target size, using the channel types and
+   *  metadata of @a like, and fills the border with the background color.
+   *  @a interior is set to the view of the canvas where the image goes, so
+   *  that whichever step produces the image can write it there directly.
+   *  Returns @a false if the image does not fit in the target size.
+   */
+  template <class T>
+  static bool make_canvas(const std::map<std::string, double>&,
+    const GenericImage<T>& like, size_t w, size_t h, GenericImage<T>& canvas,
+    GenericImage<T>& interior);
+
+  /// Prepare the padded frame, with the current properties.
+  virtual bool make_canvas(const Image8& like, size_t w, size_t h,
+      Image8& canvas, Image8& interior)
+    { return make_canvas(get_properties(), like, w, h, canvas, interior); }
+  /// Prepare the padded frame, with the current properties.
+  virtual bool make_canvas(const Image16& like, size_t w, size_t h,
+      Image16& canvas, Image16& interior)
+    { return make_canvas(get_properties(), like, w, h, canvas, interior); }
+
+ private:
+  template <class T>
+  void apply_(GenericImage<T>&, int);
 };
 
 #endif
@@ -0,0 +1,204 @@
+#include "transform.h"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+#include "effects/cropresize.h"
+#include "transforms/cubicsampler.h"
+#include "transforms/lanczossampler.h"
+#include "transforms/resizer.h"
+
+#include "image/image-impl.h"
+#include "transforms/convsampler-impl.h"
+#include "transforms/resizer-impl.h"
+#include "transforms/warper-impl.h"
+
+namespace {
+
+template <class Key, class Container>
+typename Container::mapped_type get_item_default(const Container& container,
+    const Key& key, typename Container::mapped_type def_value)
+{
+  typename Container::const_iterator i = container.find(key);
+  if (i == container.end())
+    return def_value;
+  else
+    return i -> second;
+}
+
+// the region of the transformed image that makes up the output, and the
+// size of the output
+struct Region {
+  double x0, y0, x1, y1;
+  size_t width, height;
+};
+
+Region get_region(const std::map<std::string, double>& props, size_t w,
+    size_t h)
+{
+  Region region;
+  region.x0 = get_item_default(props, "x0", 0);
+  region.y0 = get_item_default(props, "y0", 0);
+  region.x1 = (props.count("cwidth") > 0)?
+    region.x0 + get_item_default(props, "cwidth", 0):
+    get_item_default(props, "x1", w);
+  region.y1 = (props.count("cheight") > 0)?
+    region.y0 + get_item_default(props, "cheight", 0):
+    get_item_default(props, "y1", h);
+  if (region.x1 <= region.x0 || region.y1 <= region.y0)
+    throw std::runtime_error("[TransformEffect] Empty crop region.");
+
+  // adding +0.5 for rounding to nearest integer
+  region.width = get_item_default(props, "twidth",
+    region.x1 - region.x0) + 0.5;
+  region.height = get_item_default(props, "theight",
+    region.y1 - region.y0) + 0.5;
+
+  return region;
+}
+
+// the filter is chosen like in CropResizeEffect, depending on whether the
+// image is shrunk or enlarged
+template <class T>
+BaseSampler<T>* make_sampler(const AffineMap& map)
+{
+  const double area = std::sqrt(map.a*map.a + map.d*map.d)*
+    std::sqrt(map.b*map.b + map.e*map.e);
+  if (area > 1)
+    return new LanczosSampler<T>;
+  else
+    return new CubicSampler<T>;
+}
+
+} // anonymous namespace
+
+std::pair<size_t, size_t> TransformEffect::get_size(
+    const std::map<std::string, double>& props, size_t w, size_t h)
+{
+  const Region region = get_region(props, w, h);
+  return std::make_pair(region.width, region.height);
+}
+
+AffineMap TransformEffect::get_map(const std::map<std::string, double>& props,
+    size_t w, size_t h)
+{
+  const Region region = get_region(props, w, h);
+  const double angle = get_item_default(props, "angle", 0)*M_PI/180;
+  const double scale = get_item_default(props, "scale", 1);
+  if (scale <= 0)
+    throw std::runtime_error("[TransformEffect] Scale should be positive.");
+  // positions are those of pixel centers, so the center of the image is
+  // half a pixel up and left of w/2, h/2
+  const double cx = get_item_default(props, "cx", (w - 1)/2.0);
+  const double cy = get_item_default(props, "cy", (h - 1)/2.0);
+  const double dx = get_item_default(props, "dx", 0);
+  const double dy = get_item_default(props, "dy", 0);
+
+  // output pixel (i, j) is at (u, v) = (x0 + i*fx, y0 + j*fy) in the
+  // transformed image, which comes from c + R(-angle)*((u, v) - c - d)/scale
+  // in the original
+  const double fx = (region.x1 - region.x0)/region.width;
+  const double fy = (region.y1 - region.y0)/region.height;
+  const double cosa = std::cos(angle)/scale;
+  const double sina = std::sin(angle)/scale;
+  const double ox = region.x0 - cx - dx;
+  const double oy = region.y0 - cy - dy;
+
+  return AffineMap{
+    cosa*fx, sina*fy, cx + cosa*ox + sina*oy,
+    -sina*fx, cosa*fy, cy - sina*ox + cosa*oy};
+}
+
+template <class T>
+bool TransformEffect::render(const GenericImage<T>& image,
+    GenericImage<T>& target, const std::map<std::string, double>& props,
+    int verb)
+{
+  const size_t w = image.getWidth();
+  const size_t h = image.getHeight();
+  const std::pair<size_t, size_t> size = get_size(props, w, h);
+  if (size.first != target.getWidth() || size.second != target.getHeight())
+    return false;
+
+  const AffineMap map = get_map(props, w, h);
+  if (verb >= 2) {
+    std::cout << "Transforming with map (" << map.a << "," << map.b << ","
+              << map.c << ";" << map.d << "," << map.e << "," << map.f
+              << ") to (" << size.first << "," << size.second << ")"
+              << std::endl;
+  }
+
+  // without rotation, this is a crop and resize, which the resizer does
+  // faster, with separable filters; it can only do it if the region is
+  // inside the image, which has to be checked the way the resizer does it
+  const double x1 = map.c + map.a*size.first;
+  const double y1 = map.f + map.e*size.second;
+  if (map.b == 0 && map.d == 0 && Resizer<T>::canResize(w, h, map.c, map.f,
+        x1, y1, size.first, size.second)) {
+    Resizer<T> resizer;
+    resizer.setSampler(make_sampler<T>(map));
+    resizer.resize(image, map.c, map.f, x1, y1, target);
+    return true;
+  }
+
+  Warper<T> warper;
+  warper.setSampler(make_sampler<T>(map));
+  warper.warp(image, target, map);
+
+  return true;
+}
+
+template <class T>
+void TransformEffect::apply_(GenericImage<T>& image, int verb)
+{
+  const PropertyMap& props = get_properties();
+  const std::pair<size_t, size_t> size = get_size(props, image.getWidth(),
+    image.getHeight());
+
+  GenericImage<T> result;
+  result.reshape(size.first, size.second);
+  result.setChannelCount(image.getChannelCount());
+  result.allocate();
+  render(image, result, props, verb);
+  result.copyMetadataFrom(image);
+  // (setting the channel types also sets the channel count)
+  if (!image.getChannelTypes().empty())
+    result.setChannelTypes(image.getChannelTypes());
+  image = result;
+}
+
+std::map<std::string, double> TransformEffect::fuse_cropresize(
+    const std::map<std::string, double>& props,
+    const std::map<std::string, double>& crop, size_t w, size_t h)
+{
+  const Region region = get_region(props, w, h);
+  const CropResizeEffect::Geometry geom = CropResizeEffect::get_geometry(crop,
+    region.width, region.height);
+
+  // output pixel i of the crop comes from position fx0 + i*(fx1 - fx0)/width
+  // in the output of the transform, which is at x0 + fx0*fx + ... in the
+  // transformed image
+  const double fx = (region.x1 - region.x0)/region.width;
+  const double fy = (region.y1 - region.y0)/region.height;
+
+  std::map<std::string, double> result(props);
+  result.erase("cwidth");
+  result.erase("cheight");
+  result["x0"] = region.x0 + geom.fx0*fx;
+  result["y0"] = region.y0 + geom.fy0*fy;
+  result["x1"] = region.x0 + geom.fx1*fx;
+  result["y1"] = region.y0 + geom.fy1*fy;
+  result["twidth"] = geom.width;
+  result["theight"] = geom.height;
+
+  return result;
+}
+
+// the pixel types the processor works with
+template void TransformEffect::apply_(Image8&, int);
+template void TransformEffect::apply_(Image16&, int);
+template bool TransformEffect::render(const Image8&, Image8&,
+  const std::map<std::string, double>&, int);
+template bool TransformEffect::render(const Image16&, Image16&,
+  const std::map<std::string, double>&, int);
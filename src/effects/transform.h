@@ -0,0 +1,85 @@
+/** @file transform.h
+ *  @brief An effect to rotate, scale and move pictures.
+ */
+#ifndef LAPSE_TRANSFORM_H_
+#define LAPSE_TRANSFORM_H_
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <stdint.h>
+
+#include "effects/effect.h"
+#include "image/image.h"
+#include "transforms/warper.h"
+
+/** @brief Apply a rotation, scaling and translation to an image, optionally
+ *         followed by a crop and resize.
+ *
+ *  The image is rotated clockwise by @a angle degrees and scaled by @a scale
+ *  around the point (@a cx, @a cy) (by default, the center of the image),
+ *  then moved by (@a dx, @a dy) pixels. The result has the size of the
+ *  original image, with black wherever it is not covered by the picture.
+ *
+ *  The properties @a x0, @a y0, @a x1, @a y1, @a cwidth, @a cheight,
+ *  @a twidth and @a theight then crop and resize the transformed image,
+ *  like in @a CropResizeEffect, but all the coordinates can be fractional,
+ *  and everything is done in a single resampling pass. This is the way to
+ *  level a horizon and crop away the corners without losing sharpness.
+ */
+class TransformEffect : public Effect {
+ public:
+  /// Apply the effect with the current properties.
+  virtual void apply(Image8& image, int verb) { apply_(image, verb); }
+  /// Apply the effect with the current properties.
+  virtual void apply(Image16& image, int verb) { apply_(image, verb); }
+
+  /// Get the size of the output for an input of size @a w x @a h.
+  static std::pair<size_t, size_t> get_size(
+    const std::map<std::string, double>&, size_t w, size_t h);
+
+  /** @brief Find the map from output pixels to positions in an input of
+   *         size @a w x @a h.
+   */
+  static AffineMap get_map(const std::map<std::string, double>&, size_t w,
+    size_t h);
+
+  /** @brief Apply the effect to @a image, writing the output into @a target.
+   *
+   *  The @a target must already have the final size, and can be a view into
+   *  a larger image. Returns @a false if the sizes don't match.
+   */
+  template <class T>
+  static bool render(const GenericImage<T>& image, GenericImage<T>& target,
+    const std::map<std::string, double>&, int);
+
+  /// The effect can write its output into a pre-sized target.
+  virtual bool can_render() const { return true; }
+  /// Apply the effect with the current properties, writing into @a target.
+  virtual bool render(const Image8& image, Image8& target, int verb)
+    { return render(image, target, get_properties(), verb); }
+  /// Apply the effect with the current properties, writing into @a target.
+  virtual bool render(const Image16& image, Image16& target, int verb)
+    { return render(image, target, get_properties(), verb); }
+
+  /** @brief Fold a crop/resize of the output into the properties of the
+   *         transform.
+   *
+   *  @a crop are the properties of a cropresize effect applied to the output
+   *  of a transform with properties @a props, for an input of size @a w x
+   *  @a h. The result does both in one pass. The crop region is used with
+   *  sub-pixel precision only if its @a subpixel property is set, as in the
+   *  crop itself; the @a prereduce property can't be carried over, so crops
+   *  that set it should not be fused.
+   */
+  static std::map<std::string, double> fuse_cropresize(
+    const std::map<std::string, double>& props,
+    const std::map<std::string, double>& crop, size_t w, size_t h);
+
+ private:
+  template <class T>
+  void apply_(GenericImage<T>&, int);
+};
+
+#endif
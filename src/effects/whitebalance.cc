@@ -1,11 +1,16 @@
 #include "whitebalance.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
 #include "color/profilefactory.h"
+#include "color/srgb.h"
 #include "color/transformfactory.h"
 #include "image/image-impl.h"
+#include "misc/cpudispatch.h"
+#include "misc/threadpool.h"
 
 typedef GenericImage<float> Image32;
 
@@ -46,17 +51,65 @@ inline double dot(const Color3& a, const Color3& b)
   return a.X*b.X + a.Y*b.Y + a.Z*b.Z;
 }
 
-inline Color3 to_lms(const Color3& color)
-{
-  Color3 res;
+// a 3x3 matrix, by rows
+struct Matrix3 {
+  double m[3][3];
+
+  Color3 operator*(const Color3& color) const {
+    return Color3{dot(Color3{m[0][0], m[0][1], m[0][2]}, color),
+                  dot(Color3{m[1][0], m[1][1], m[1][2]}, color),
+                  dot(Color3{m[2][0], m[2][1], m[2][2]}, color)};
+  }
 
-  res.X = dot(Color3{0.7328, 0.4296, -0.1624}, color);
-  res.Y = dot(Color3{-0.7036, 1.6975, 0.0061}, color);
-  res.Z = dot(Color3{0.0030, 0.0136, 0.9834}, color);
+  Matrix3 operator*(const Matrix3& other) const {
+    Matrix3 res;
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        res.m[i][j] = m[i][0]*other.m[0][j] + m[i][1]*other.m[1][j] +
+          m[i][2]*other.m[2][j];
+    return res;
+  }
+};
 
+inline Matrix3 diagonal(const Color3& d)
+{
+  return Matrix3{{{d.X, 0, 0}, {0, d.Y, 0}, {0, 0, d.Z}}};
+}
+
+inline Matrix3 inverse(const Matrix3& a)
+{
+  const double (&m)[3][3] = a.m;
+  const double det = m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) -
+    m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0]) +
+    m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+  Matrix3 res;
+  for (size_t i = 0; i < 3; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      // cofactor of element (j, i)
+      const size_t r1 = (j + 1)%3, r2 = (j + 2)%3;
+      const size_t c1 = (i + 1)%3, c2 = (i + 2)%3;
+      res.m[i][j] = (m[r1][c1]*m[r2][c2] - m[r1][c2]*m[r2][c1])/det;
+    }
+  }
   return res;
 }
 
+// XYZ to LMS, and back; the second is only approximately the inverse of the
+// first
+const Matrix3 xyz_to_lms{{
+  {0.7328, 0.4296, -0.1624},
+  {-0.7036, 1.6975, 0.0061},
+  {0.0030, 0.0136, 0.9834}}};
+const Matrix3 lms_to_xyz{{
+  {1.0961, -0.2789, 0.1827},
+  {0.4544, 0.4735, 0.0721},
+  {-0.0096, -0.0057, 1.0153}}};
+
+inline Color3 to_lms(const Color3& color)
+{
+  return xyz_to_lms*color;
+}
+
 // return the LMS color from (x,y) assuming Y = 1
 inline Color3 to_lms(const Color& col2)
 {
@@ -65,13 +118,7 @@ inline Color3 to_lms(const Color& col2)
 
 inline Color3 to_xyz(const Color3& color)
 {
-  Color3 res;
-
-  res.X = dot(Color3{1.0961, -0.2789, 0.1827}, color);
-  res.Y = dot(Color3{0.4544, 0.4735, 0.0721}, color);
-  res.Z = dot(Color3{-0.0096, -0.0057, 1.0153}, color);
-
-  return res;
+  return lms_to_xyz*color;
 }
 
 inline Color get_color_from_temp(double t)
@@ -96,100 +143,269 @@ inline std::ostream& operator<<(std::ostream& out, const Color& color)
   return out << "(" << color.x << "," << color.y << ")";
 }
 
-void shift(Image32& image, const Color& old_color, const Color& new_color,
-    bool, bool lms)
+// the shift of colors as a matrix acting on XYZ
+Matrix3 get_xyz_matrix(const Color& old_color, const Color& new_color,
+    bool lms)
 {
-  const Color color_factor{new_color.x/old_color.x, new_color.y/old_color.y};
-  Color3 factors;
   if (lms) {
-    Color3 old_color3 = to_lms(old_color);
-    Color3 new_color3 = to_lms(new_color);
+    // XXX should use an adaptation <1!
+    // convert to LMS, do the transformation there, then go back
+    const Color3 old_color3 = to_lms(old_color);
+    const Color3 new_color3 = to_lms(new_color);
+    const Color3 factors{new_color3.X/old_color3.X,
+      new_color3.Y/old_color3.Y, new_color3.Z/old_color3.Z};
+    return lms_to_xyz*diagonal(factors)*xyz_to_lms;
+  } else {
+    // scale x and y, keeping X + Y + Z the same, then rescale to keep Y
+    const Color f{new_color.x/old_color.x, new_color.y/old_color.y};
+    return Matrix3{{
+      {f.x/f.y, 0, 0},
+      {0, 1, 0},
+      {(1 - f.x)/f.y, (1 - f.y)/f.y, 1/f.y}}};
+  }
+}
+
+// a matrix in single precision, for the pixel kernels
+struct ShiftParams {
+  float m[3][3];
+  // whether to keep overblown channels overblown
+  bool protect;
 
-    factors.X = new_color3.X / old_color3.X;
-    factors.Y = new_color3.Y / old_color3.Y;
-    factors.Z = new_color3.Z / old_color3.Z;
+  ShiftParams(const Matrix3& matrix, bool p) : protect(p) {
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        m[i][j] = matrix.m[i][j];
   }
+};
 
-  for (size_t j = 0; j < image.getHeight(); ++j) {
-    for (size_t i = 0; i < image.getWidth(); ++i) {
-      float* p = image(i, j);
-      const float sum = p[0] + p[1] + p[2];
-      if (!lms) {
-        p[2] = (sum - color_factor.x*p[0] - color_factor.y*p[1])/color_factor.y;
-        p[0] *= color_factor.x/color_factor.y;
-      } else {
-        // XXX should use an adaptation <1!
-        // need to convert to LMS, do the transformation there, then go back
-        Color3 lms_color = to_lms(Color3{p[0], p[1], p[2]});
-
-        lms_color.X *= factors.X;
-        lms_color.Y *= factors.Y;
-        lms_color.Z *= factors.Z;
-
-        const Color3 new_xyz = to_xyz(lms_color);
-        p[0] = new_xyz.X; p[1] = new_xyz.Y; p[2] = new_xyz.Z;
-      }
-    }
+// shift the colors of n pixels whose X, Y, Z channels are at px, py, pz,
+// with consecutive pixels step elements apart
+inline void shift_row(float* px, float* py, float* pz, size_t n, int step,
+    const ShiftParams& params)
+{
+  const float (&m)[3][3] = params.m;
+  for (size_t i = 0; i < n; ++i) {
+    const float X = px[i*step];
+    const float Y = py[i*step];
+    const float Z = pz[i*step];
+    px[i*step] = m[0][0]*X + m[0][1]*Y + m[0][2]*Z;
+    py[i*step] = m[1][0]*X + m[1][1]*Y + m[1][2]*Z;
+    pz[i*step] = m[2][0]*X + m[2][1]*Y + m[2][2]*Z;
   }
 }
 
-void shift(Image8& image8, const Color& old_color, const Color& new_color,
-    bool protect, bool lms)
+LAPSE_TARGET_AVX2 void shift_row_avx2(float* px, float* py, float* pz,
+    size_t n, int step, const ShiftParams& params)
 {
-  Image8 mask;
-  if (protect) {
-    // identify overblown channels
-    mask.reshape(image8.getWidth(), image8.getHeight());
-    mask.setChannelCount(image8.getChannelCount());
-    mask.setChannelTypes(image8.getChannelTypes());
-    mask.allocate();
-
-    const size_t n = image8.getSize();
-    const Image8::value_type* data0 = image8.getData();
-    Image8::value_type* pmask = mask.getData();
-    for (size_t i = 0; i < n; ++i) {
-      *pmask++ = (*data0++ == 255?1:0);
-    }
+  shift_row(px, py, pz, n, step, params);
+}
+
+LAPSE_TARGET_AVX512 void shift_row_avx512(float* px, float* py, float* pz,
+    size_t n, int step, const ShiftParams& params)
+{
+  shift_row(px, py, pz, n, step, params);
+}
+
+void shift(Image32& image, const Matrix3& matrix)
+{
+  const ShiftParams params(matrix, false);
+
+  typedef void (*Kernel)(float*, float*, float*, size_t, int,
+    const ShiftParams&);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &shift_row, &shift_row_avx2, &shift_row_avx512);
+
+  // work on the X, Y, Z channels separately; for planar images these are
+  // contiguous arrays, which lets the compiler vectorize the loops
+  const size_t width = image.getWidth();
+  for (auto row = image.rowBegin(); row != image.rowEnd(); ++row) {
+    kernel(row.channel(0), row.channel(1), row.channel(2), width,
+      row.getPixelStride(), params);
+  }
+}
+
+// shift the color of an 8-bit sRGB pixel whose channels are cstride apart,
+// using a matrix that acts on linear sRGB; overblown channels are checked on
+// the input, before anything is written
+inline void shift_rgb_pixel(Image8::value_type* p, int cstride,
+    const SrgbTables& tables, const ShiftParams& params)
+{
+  const float (&m)[3][3] = params.m;
+  const float r = tables.toLinear(p[0]);
+  const float g = tables.toLinear(p[cstride]);
+  const float b = tables.toLinear(p[2*cstride]);
+  for (size_t k = 0; k < 3; ++k) {
+    Image8::value_type& value = p[k*cstride];
+    if (params.protect && value == 255)
+      continue;
+    value = tables.fromLinear(m[k][0]*r + m[k][1]*g + m[k][2]*b);
   }
+}
 
-  ColorProfile sRGB = ColorProfileFactory::fromBuiltin("sRGB");
-  ColorProfile XYZ = ColorProfileFactory::fromBuiltin("XYZ");
+// shift the colors of n contiguous pixels
+inline void shift_rgb_row(Image8::value_type* data, size_t n,
+    const ShiftParams& params)
+{
+  const SrgbTables& tables = SrgbTables::getInstance();
+  for (size_t i = 0; i < n; ++i)
+    shift_rgb_pixel(data + 3*i, 1, tables, params);
+}
+
+LAPSE_TARGET_AVX2 void shift_rgb_row_avx2(Image8::value_type* data, size_t n,
+    const ShiftParams& params)
+{
+  shift_rgb_row(data, n, params);
+}
+
+LAPSE_TARGET_AVX512 void shift_rgb_row_avx512(Image8::value_type* data,
+    size_t n, const ShiftParams& params)
+{
+  shift_rgb_row(data, n, params);
+}
+
+// shift the colors of a row of pixels with arbitrary strides
+void shift_rgb_pixels(const RowIterator<Image8::value_type>& row,
+    const ShiftParams& params)
+{
+  const SrgbTables& tables = SrgbTables::getInstance();
+  const int cstride = row.getChannelStride();
+  for (size_t x = 0; x < row.getWidth(); ++x)
+    shift_rgb_pixel(row(x), cstride, tables, params);
+}
+
+// shift the colors of an sRGB image directly, if possible; returns false if
+// the image has to go through XYZ instead
+bool shift_rgb(Image8& image8, const Matrix3& xyz_matrix, bool protect)
+{
+  const std::string& types = image8.getChannelTypes();
+  if (types != "rgb" && types != "bgr")
+    return false;
+
+  // the white balance is linear in XYZ, and so in linear sRGB
+  Matrix3 to_xyz;
+  std::copy(&srgbToXyzD50[0][0], &srgbToXyzD50[0][0] + 9, &to_xyz.m[0][0]);
+  Matrix3 matrix = inverse(to_xyz)*xyz_matrix*to_xyz;
+  if (types == "bgr") {
+    const Matrix3 rgb = matrix;
+    for (size_t i = 0; i < 3; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        matrix.m[i][j] = rgb.m[2 - i][2 - j];
+  }
+  const ShiftParams params(matrix, protect);
+
+  typedef void (*Kernel)(Image8::value_type*, size_t, const ShiftParams&);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &shift_rgb_row, &shift_rgb_row_avx2, &shift_rgb_row_avx512);
+
+  // the rows are independent, so share them out like the color transforms
+  const size_t width = image8.getWidth();
+  ThreadPool::getInstance().parallelFor(image8.getHeight(),
+    [&](size_t y1, size_t y2) {
+      for (size_t y = y1; y < y2; ++y) {
+        const RowIterator<Image8::value_type> row = image8.row(y);
+        if (row.isContiguous())
+          kernel(row.getData(), width, params);
+        else
+          shift_rgb_pixels(row, params);
+      }
+    }, 16);
+
+  return true;
+}
+
+// other pixel types always go through XYZ
+template <class T>
+bool shift_rgb(GenericImage<T>&, const Matrix3&, bool)
+{
+  return false;
+}
+
+template <class T>
+void shift(GenericImage<T>& image, const Matrix3& matrix, bool protect,
+    ColorTransformCache& to_xyz, ColorTransformCache& from_xyz)
+{
+  if (shift_rgb(image, matrix, protect))
+    return;
 
   // convert the image to XYZ first
   Image32 image32;
-  image32.reshape(image8.getWidth(), image8.getHeight());
+  image32.reshape(image.getWidth(), image.getHeight());
   image32.setChannelCount(3);
   image32.setChannelTypes("XYZ");
-  image32.allocate();
+  // the color math is done per channel, so store the channels separately
+  image32.allocate(LAYOUT_PLANAR);
 
-  ColorTransform transform = ColorTransformFactory::fromProfiles(
-    sRGB, image8, XYZ, image32, INTENT_PERCEPTUAL);
-  transform.apply(image8.getData(), image32.getData(),
-    image8.getWidth()*image8.getHeight());
+  to_xyz.get(image, image32).apply(image, image32);
 
-  shift(image32, old_color, new_color, protect, lms);
+  shift(image32, matrix);
 
   // convert back to sRGB
-  ColorTransform transform_back = ColorTransformFactory::fromProfiles(
-    XYZ, image32, sRGB, image8, INTENT_PERCEPTUAL);
-  transform_back.apply(image32.getData(), image8.getData(),
-    image8.getWidth()*image8.getHeight());
-
-  if (protect) {
-    // make sure overblown channels stay overblown
-    const size_t n = image8.getSize();
-    Image8::value_type* data0 = image8.getData();
-    const Image8::value_type* pmask = mask.getData();
-    for (size_t i = 0; i < n; ++i, ++data0)
-      if (*pmask++) *data0 = 255;
+  const ColorTransform& transform_back = from_xyz.get(image32, image);
+  if (!protect) {
+    transform_back.apply(image32, image);
+    return;
+  }
+
+  // convert back a band of rows at a time, so that the input can still be
+  // checked for overblown channels when writing the output
+  const size_t width = image.getWidth();
+  const size_t height = image.getHeight();
+  const size_t ncomps = image.getChannelCount();
+  const T max = std::numeric_limits<T>::max();
+  const size_t band_height = std::min<size_t>(64, height);
+  GenericImage<T> band;
+  band.reshape(width, band_height);
+  // the channel types only set the count when there are some
+  band.setChannelTypes(image.getChannelTypes());
+  band.setChannelCount(ncomps);
+  band.allocate();
+  for (size_t y0 = 0; y0 < height; y0 += band_height) {
+    const size_t rows = std::min(band_height, height - y0);
+    GenericImage<T> out = band.cropped(0, 0, width, rows);
+    transform_back.apply(image32.cropped(0, y0, width, rows), out);
+    for (size_t y = 0; y < rows; ++y) {
+      const RowIterator<T> row = image.row(y0 + y);
+      const RowIterator<T> out_row = out.row(y);
+      const int cstride = row.getChannelStride();
+      for (size_t x = 0; x < width; ++x) {
+        T* p = row(x);
+        const T* q = out_row(x);
+        for (size_t k = 0; k < ncomps; ++k)
+          if (p[k*cstride] != max) p[k*cstride] = q[k];
+      }
+    }
   }
 }
 
 } // anonymous namespace
 
-void WhiteBalanceEffect::operator()(Image8& image,
-    const std::map<std::string, double>& props, int verb)
+ColorTransformCache& WhiteBalanceEffect::to_xyz_()
 {
+  if (!to_xyz_cache_) {
+    to_xyz_cache_.reset(new ColorTransformCache(
+      ColorProfileFactory::fromBuiltin("sRGB"),
+      ColorProfileFactory::fromBuiltin("XYZ")));
+  }
+  return *to_xyz_cache_;
+}
+
+ColorTransformCache& WhiteBalanceEffect::from_xyz_()
+{
+  if (!from_xyz_cache_) {
+    from_xyz_cache_.reset(new ColorTransformCache(
+      ColorProfileFactory::fromBuiltin("XYZ"),
+      ColorProfileFactory::fromBuiltin("sRGB")));
+  }
+  return *from_xyz_cache_;
+}
+
+void WhiteBalanceEffect::update_matrix_(int verb)
+{
+  const PropertyMap& props = get_properties();
+  matrix_valid_ = true;
+  active_ = false;
+
+  Matrix3 matrix;
   if (props.count("overblow_prot") > 0) {
     overblown_protection_ = get_item(props, "overblow_prot") >= 0.5;
   }
@@ -205,7 +421,7 @@ void WhiteBalanceEffect::operator()(Image8& image,
     }
 
     // this wouldn't do the right thing in LMS, so we disable that
-    shift(image, Color{1, 1}, color_factor, overblown_protection_, false);
+    matrix = get_xyz_matrix(Color{1, 1}, color_factor, false);
   } else {
     // decide on an origin color
     Color old_color;
@@ -222,11 +438,7 @@ void WhiteBalanceEffect::operator()(Image8& image,
           (unsigned char)get_item(props, "srcb")};
       Color3 old_color3;
 
-      ColorProfile sRGB = ColorProfileFactory::fromBuiltin("sRGB");
-      ColorProfile XYZ = ColorProfileFactory::fromBuiltin("XYZ");
-
-      ColorTransform transform = ColorTransformFactory::fromProfiles(
-        sRGB, TYPE_RGB_8, XYZ, TYPE_XYZ_DBL, INTENT_PERCEPTUAL);
+      ColorTransform transform = to_xyz_().get(TYPE_RGB_8, TYPE_XYZ_DBL);
       transform.apply(old_color_rgb, &old_color3, 1);
 
       const double csum = old_color3.X + old_color3.Y + old_color3.Z;
@@ -252,11 +464,7 @@ void WhiteBalanceEffect::operator()(Image8& image,
     } else if (props.count("x") > 0 && props.count("y") > 0) {
       new_color = Color{get_item(props, "x"), get_item(props, "y")};
     } else {
-      ColorProfile sRGB = ColorProfileFactory::fromBuiltin("sRGB");
-      ColorProfile XYZ = ColorProfileFactory::fromBuiltin("XYZ");
-
-      ColorTransform transform = ColorTransformFactory::fromProfiles(
-        sRGB, TYPE_RGB_8, XYZ, TYPE_XYZ_DBL, INTENT_PERCEPTUAL);
+      ColorTransform transform = to_xyz_().get(TYPE_RGB_8, TYPE_XYZ_DBL);
       const unsigned char white_color_rgb[3] = {128, 128, 128};
       Color3 white_color3;
       transform.apply(white_color_rgb, &white_color3, 1);
@@ -274,6 +482,26 @@ void WhiteBalanceEffect::operator()(Image8& image,
       }
       std::cout << std::endl;
     }
-    shift(image, old_color, new_color, overblown_protection_, use_lms_);
+    matrix = get_xyz_matrix(old_color, new_color, use_lms_);
   }
+
+  std::copy(&matrix.m[0][0], &matrix.m[0][0] + 9, &matrix_[0][0]);
+  active_ = true;
 }
+
+template <class T>
+void WhiteBalanceEffect::apply_(GenericImage<T>& image, int verb)
+{
+  if (!matrix_valid_)
+    update_matrix_(verb);
+  if (!active_)
+    return;
+
+  Matrix3 matrix;
+  std::copy(&matrix_[0][0], &matrix_[0][0] + 9, &matrix.m[0][0]);
+  shift(image, matrix, overblown_protection_, to_xyz_(), from_xyz_());
+}
+
+// the pixel types the processor works with
+template void WhiteBalanceEffect::apply_(Image8&, int);
+template void WhiteBalanceEffect::apply_(Image16&, int);
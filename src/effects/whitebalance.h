@@ -7,19 +7,28 @@
 #include <string>
 #include <map>
 
-#include "image/image.h"
+#include <boost/shared_ptr.hpp>
+
+#include <stdint.h>
 
-typedef GenericImage<unsigned char> Image8;
+#include "color/transformcache.h"
+#include "effects/effect.h"
+#include "image/image.h"
 
-/// Apply a white balance effect.
-class WhiteBalanceEffect {
+/** @brief Apply a white balance effect.
+ *
+ *  The color shift is worked out as a matrix acting on XYZ when the
+ *  properties change, and kept for the following frames, along with the
+ *  color transforms.
+ */
+class WhiteBalanceEffect : public Effect {
  public:
   /// Constructor.
   WhiteBalanceEffect() : ref_temp_(5500), overblown_protection_(true),
-    use_lms_(true) {}
+    use_lms_(true), matrix_valid_(false), active_(false) {}
 
   /// Set reference color temperature.
-  void set_ref_temp(double t) { ref_temp_ = t; }
+  void set_ref_temp(double t) { ref_temp_ = t; matrix_valid_ = false; }
   /// Get reference color temperature.
   double get_ref_temp() const { return ref_temp_; }
 
@@ -44,25 +53,49 @@ class WhiteBalanceEffect {
    *         color space.
    *
    *  The transformation will induce strange color casts if XYZ is not used.
-   *  The transformation is somewhat slower in LMS space, though.
+   *  Either way, for 8-bit RGB images the whole change is folded into a
+   *  single matrix acting on linear sRGB, so both cost the same; 16-bit
+   *  images are converted to XYZ with LCMS.
    */
-  void set_use_lms(bool b) { use_lms_ = b; }
+  void set_use_lms(bool b) { use_lms_ = b; matrix_valid_ = false; }
   /** @brief Get whether the transformation uses LMS or XYZ color space.
    *
    *  @see set_use_lms
    */
   bool get_use_lms() const { return use_lms_; }
 
-  /// Apply white balance effect.
-  void operator()(Image8&, const std::map<std::string, double>&, int);
+  /// Apply the white balance effect with the current properties.
+  virtual void apply(Image8& image, int verb) { apply_(image, verb); }
+  /// Apply the white balance effect with the current properties.
+  virtual void apply(Image16& image, int verb) { apply_(image, verb); }
+
+ protected:
+  virtual void properties_changed_() { matrix_valid_ = false; }
 
  private:
+  template <class T>
+  void apply_(GenericImage<T>&, int);
+  // work out the color shift from the current properties
+  void update_matrix_(int verb);
+  // the transforms to XYZ and back
+  ColorTransformCache& to_xyz_();
+  ColorTransformCache& from_xyz_();
+
   /// Reference color temperature.
   double    ref_temp_;
   /// Overblown color protection.
   bool      overblown_protection_;
   /// Whether to do the transformation in LMS space.
   bool      use_lms_;
+
+  /// The color shift, as a matrix acting on XYZ.
+  double    matrix_[3][3];
+  /// Whether @a matrix_ is up to date with the properties.
+  bool      matrix_valid_;
+  /// Whether the properties call for any change.
+  bool      active_;
+  /// Transforms to XYZ and back.
+  boost::shared_ptr<ColorTransformCache>    to_xyz_cache_, from_xyz_cache_;
 };
 
 #endif
@@ -4,15 +4,19 @@
 
 #include <algorithm>
 #include <stdexcept>
+#include <vector>
 
 #include <cmath>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <jerror.h>
+
 #include "image/metadata.h"
 #include "image/image-impl.h"
 #include "misc/endian.h"
+#include "misc/trace.h"
 
 typedef JpegIO::Image Image;
 
@@ -35,6 +39,68 @@ static void cErrorExit(j_common_ptr cinfo)
   throw std::runtime_error(errText);
 }
 
+// a source manager reading from a file, like the one set up by
+// jpeg_stdio_src, except that each read is recorded as a trace span, so that
+// the time spent on I/O shows apart from the decoding
+struct cFileSource {
+  jpeg_source_mgr         pub;      // "public" fields
+  FILE*                   file;
+  std::vector<JOCTET>     buffer;
+};
+
+static void cInitSource(j_decompress_ptr)
+{
+}
+
+static boolean cFillInputBuffer(j_decompress_ptr cinfo)
+{
+  cFileSource* src = (cFileSource*)cinfo -> src;
+  TraceSpan span("load", "read");
+  size_t n = fread(&src -> buffer[0], 1, src -> buffer.size(), src -> file);
+  if (n == 0) {
+    // insert a fake EOI marker, as libjpeg's own source managers do
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    src -> buffer[0] = (JOCTET)0xFF;
+    src -> buffer[1] = (JOCTET)JPEG_EOI;
+    n = 2;
+  }
+  src -> pub.next_input_byte = &src -> buffer[0];
+  src -> pub.bytes_in_buffer = n;
+  return TRUE;
+}
+
+static void cSkipInputData(j_decompress_ptr cinfo, long count)
+{
+  jpeg_source_mgr* src = cinfo -> src;
+  if (count <= 0)
+    return;
+  while (count > (long)src -> bytes_in_buffer) {
+    count -= src -> bytes_in_buffer;
+    cFillInputBuffer(cinfo);
+  }
+  src -> next_input_byte += count;
+  src -> bytes_in_buffer -= count;
+}
+
+static void cTermSource(j_decompress_ptr)
+{
+}
+
+static void cFileSourceInit(j_decompress_ptr cinfo, cFileSource& src,
+    FILE* file)
+{
+  src.pub.init_source = cInitSource;
+  src.pub.fill_input_buffer = cFillInputBuffer;
+  src.pub.skip_input_data = cSkipInputData;
+  src.pub.resync_to_restart = jpeg_resync_to_restart;
+  src.pub.term_source = cTermSource;
+  src.pub.bytes_in_buffer = 0;
+  src.pub.next_input_byte = 0;
+  src.file = file;
+  src.buffer.resize(65536);
+  cinfo -> src = &src.pub;
+}
+
 static int jpegGetCharacter(j_decompress_ptr pstatus)
 {
   if (pstatus -> src -> bytes_in_buffer == 0)
@@ -357,6 +423,37 @@ static void writeProfiles(j_compress_ptr pstatus, const Image& image)
   }
 }
 
+static void setMarkerProcessors(j_decompress_ptr pstatus)
+{
+  jpeg_set_marker_processor(pstatus, JPEG_COM, readComment);
+  jpeg_set_marker_processor(pstatus, ICC_MARKER, readColorProfile);
+  jpeg_set_marker_processor(pstatus, IPTC_MARKER, readIptcProfile);
+  for (int i = 1; i < 16; ++i) {
+    const unsigned j = JPEG_APP0 + i;
+    if (j != JPEG_COM && j != ICC_MARKER && j != IPTC_MARKER)
+      jpeg_set_marker_processor(pstatus, j, readOtherProfile);
+  }
+}
+
+static J_COLOR_SPACE colorspaceFromChannelTypes(const std::string& chTypes)
+{
+  if (chTypes == "k") {
+    return JCS_GRAYSCALE;
+  } else if (chTypes == "rgb") {
+    return JCS_RGB;
+  } else if (chTypes == "bgr") {
+    return JCS_EXT_BGR;
+  } else if (chTypes == "YCC") {
+    return JCS_YCbCr;
+  } else if (chTypes == "cmyk") {
+    return JCS_CMYK;
+  } else if (chTypes == "YCCk") {
+    return JCS_YCCK;
+  } else {
+    throw std::runtime_error("[JpegIO::write] Unrecognized color space.");
+  }
+}
+
 std::string JpegIO::convertColorspace(J_COLOR_SPACE space)
 {
   std::string result;
@@ -560,19 +657,14 @@ Image JpegIO::load(const std::string& name) const
 
   // initialize decompression object
   jpeg_create_decompress(&status);
-  jpeg_stdio_src(&status, file);
+  cFileSource source;
+  cFileSourceInit(&status, source, file);
 
   // setup some handlers for various metadata
-  jpeg_set_marker_processor(&status, JPEG_COM, readComment);
-  jpeg_set_marker_processor(&status, ICC_MARKER, readColorProfile);
-  jpeg_set_marker_processor(&status, IPTC_MARKER, readIptcProfile);
-  for (int i = 1; i < 16; ++i) {
-    const unsigned j = JPEG_APP0 + i;
-    if (j != JPEG_COM && j != ICC_MARKER && j != IPTC_MARKER)
-      jpeg_set_marker_processor(&status, j, readOtherProfile);
-  }
+  setMarkerProcessors(&status);
 
   // read the header
+  TraceSpan headerSpan("load", "header");
   jpeg_read_header(&status, true);
 
   // handle the size hint
@@ -586,6 +678,7 @@ Image JpegIO::load(const std::string& name) const
 
   // start decompression
   jpeg_start_decompress(&status);
+  headerSpan.end();
 
   result.reshape(status.output_width, status.output_height);
   result.setChannelCount(status.output_components);
@@ -603,7 +696,9 @@ Image JpegIO::load(const std::string& name) const
   // the input to jpeg_read_scanlines is an array of pointers...
   JSAMPARRAY ptrs = new JSAMPROW[rowstep];
 
-  // read!
+  // read! libjpeg does the entropy decoding, the inverse DCT and the color
+  // conversion a few rows at a time, so these can't be timed separately
+  TraceSpan decodeSpan("load", "decode");
   while (status.output_scanline < status.output_height) {
     for (size_t i = 0; i < rowstep; ++i) {
       ptrs[i] = result(0, status.output_scanline + i);
@@ -619,6 +714,7 @@ Image JpegIO::load(const std::string& name) const
 
   jpeg_finish_decompress(&status);
   jpeg_destroy_decompress(&status);
+  decodeSpan.end();
 
   fclose(file);
 
@@ -687,9 +783,11 @@ void JpegIO::write(const std::string& name, const Image& img0) const
   if (!(file = fopen(name.c_str(), "wb")))
     throw std::runtime_error("[JpegIO::write]: Couldn't open file.");
 
-  // need a flat image to write to file
+  // libjpeg needs the pixels in each row to be adjacent, but doesn't care
+  // where the rows are, so only flatten if necessary
   Image img(img0);
-  img.flatten();
+  if (!img.hasContiguousRows())
+    img.flatten();
 
   // setup the image as "client data", to have access to some members
   // the C API can't treat this as a const, need a const_cast...
@@ -704,22 +802,7 @@ void JpegIO::write(const std::string& name, const Image& img0) const
   status.image_height = img.getHeight();
   status.input_components = img.getChannelCount();
   
-  const std::string& chTypes = img.getChannelTypes();
-  if (chTypes == "k") {
-    status.in_color_space = JCS_GRAYSCALE;
-  } else if (chTypes == "rgb") {
-    status.in_color_space = JCS_RGB;
-  } else if (chTypes == "bgr") {
-    status.in_color_space = JCS_EXT_BGR;
-  } else if (chTypes == "YCC") {
-    status.in_color_space = JCS_YCbCr;
-  } else if (chTypes == "cmyk") {
-    status.in_color_space = JCS_CMYK;
-  } else if (chTypes == "YCCk") {
-    status.in_color_space = JCS_YCCK;
-  } else {
-    throw std::runtime_error("[JpegIO::write] Unrecognized color space.");
-  }
+  status.in_color_space = colorspaceFromChannelTypes(img.getChannelTypes());
 
   // XXX have more settings
   jpeg_set_defaults(&status);
@@ -764,3 +847,203 @@ void JpegIO::write(const std::string& name, const Image& img0) const
   // notify the callback that we're done
   notifyCallback_(status.image_height, status.image_height);
 }
+
+
+JpegIO::RawImage JpegIO::loadRaw(const std::string& name) const
+{
+  RawImage result;
+  // the metadata handlers need an image to write to
+  Image info;
+
+  // open file
+  FILE* file = 0;
+
+  if (!(file = fopen(name.c_str(), "rb")))
+    throw std::runtime_error("[JpegIO::loadRaw]: Couldn't open file.");
+
+  jpeg_decompress_struct status;
+  cErrorManager jerr;
+
+  // setup error handler
+  status.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = cErrorExit;
+
+  status.client_data = &info;
+
+  // initialize decompression object
+  jpeg_create_decompress(&status);
+  jpeg_stdio_src(&status, file);
+
+  setMarkerProcessors(&status);
+
+  // read the header
+  jpeg_read_header(&status, true);
+
+  // get the components exactly as they are stored: no color conversion, no
+  // upsampling, no scaling
+  status.raw_data_out = true;
+  status.out_color_space = status.jpeg_color_space;
+  status.scale_num = 1;
+  status.scale_denom = 1;
+
+  jpeg_start_decompress(&status);
+
+  result.reshape(status.image_width, status.image_height);
+  result.setChannelTypes(convertColorspace(status.jpeg_color_space));
+  const size_t ncomps = status.num_components;
+  if (ncomps != result.getChannelTypes().length())
+    throw std::runtime_error("[JpegIO::loadRaw] Number of components does not "
+      "match channel descriptions.");
+
+  // libjpeg works with whole blocks, and one call to jpeg_read_raw_data
+  // returns a full iMCU row, so the planes need some padding
+  std::vector<Image> padded(ncomps);
+  std::vector<std::vector<JSAMPROW> > rows(ncomps);
+  std::vector<JSAMPARRAY> ptrs(ncomps);
+  for (size_t c = 0; c < ncomps; ++c) {
+    const jpeg_component_info& comp = status.comp_info[c];
+    padded[c].reshape(comp.width_in_blocks*DCTSIZE,
+      status.total_iMCU_rows*comp.v_samp_factor*DCTSIZE);
+    padded[c].setChannelCount(1);
+    padded[c].setChannelTypes(result.getChannelTypes().substr(c, 1));
+    padded[c].allocate();
+
+    rows[c].resize(comp.v_samp_factor*DCTSIZE);
+    ptrs[c] = &rows[c][0];
+  }
+
+  // read!
+  const size_t rowstep = status.max_v_samp_factor*DCTSIZE;
+  for (size_t k = 0; status.output_scanline < status.output_height; ++k) {
+    for (size_t c = 0; c < ncomps; ++c) {
+      const size_t n = rows[c].size();
+      for (size_t i = 0; i < n; ++i)
+        rows[c][i] = padded[c](0, k*n + i);
+    }
+    jpeg_read_raw_data(&status, &ptrs[0], rowstep);
+
+    if (!notifyCallback_(status.output_scanline, status.output_height))
+      break;
+  }
+
+  // remove the padding
+  for (size_t c = 0; c < ncomps; ++c) {
+    const jpeg_component_info& comp = status.comp_info[c];
+    padded[c].crop(0, 0, comp.downsampled_width, comp.downsampled_height);
+    RawImage::Sampling sampling = {comp.h_samp_factor, comp.v_samp_factor};
+    result.addPlane(padded[c], sampling);
+  }
+  if (ncomps > 0)
+    result.getPlane(0).copyMetadataFrom(info);
+
+  // finish & clean up
+  jpeg_finish_decompress(&status);
+  jpeg_destroy_decompress(&status);
+
+  fclose(file);
+
+  // notify the callback that we're done
+  notifyCallback_(status.output_height, status.output_height);
+
+  return result;
+}
+
+void JpegIO::writeRaw(const std::string& name, const RawImage& img) const
+{
+  img.check();
+  const size_t ncomps = img.getPlaneCount();
+  if (ncomps == 0 || ncomps != img.getChannelTypes().length())
+    throw std::runtime_error("[JpegIO::writeRaw] Number of planes does not "
+      "match channel descriptions.");
+
+  // open file
+  FILE* file = 0;
+
+  jpeg_compress_struct status;
+  cErrorManager jerr;
+
+  // setup error handler
+  status.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = cErrorExit;
+
+  if (!(file = fopen(name.c_str(), "wb")))
+    throw std::runtime_error("[JpegIO::writeRaw]: Couldn't open file.");
+
+  // the metadata is stored with the first plane
+  const Image& info = img.getPlane(0);
+  status.client_data = const_cast<Image*>(&info);
+
+  // initialize compression object
+  jpeg_create_compress(&status);
+  jpeg_stdio_dest(&status, file);
+
+  // set compression parameters
+  status.image_width = img.getWidth();
+  status.image_height = img.getHeight();
+  status.input_components = ncomps;
+  status.in_color_space = colorspaceFromChannelTypes(img.getChannelTypes());
+
+  jpeg_set_defaults(&status);
+  jpeg_set_quality(&status, writeQuality_, true);
+
+  // the data is already in the JPEG color space, at the right resolution
+  status.raw_data_in = true;
+  for (size_t c = 0; c < ncomps; ++c) {
+    status.comp_info[c].h_samp_factor = img.getSampling(c).h;
+    status.comp_info[c].v_samp_factor = img.getSampling(c).v;
+  }
+
+  // start compression
+  jpeg_start_compress(&status, true);
+
+  writeComment(&status, info);
+  writeProfiles(&status, info);
+
+  // libjpeg wants whole blocks, a full iMCU row at a time; pad by repeating
+  // the last column and row of each plane
+  std::vector<std::vector<JSAMPLE> > buffers(ncomps);
+  std::vector<std::vector<JSAMPROW> > rows(ncomps);
+  std::vector<JSAMPARRAY> ptrs(ncomps);
+  for (size_t c = 0; c < ncomps; ++c) {
+    const jpeg_component_info& comp = status.comp_info[c];
+    const size_t width = comp.width_in_blocks*DCTSIZE;
+    const size_t n = comp.v_samp_factor*DCTSIZE;
+    buffers[c].resize(width*n);
+    rows[c].resize(n);
+    for (size_t i = 0; i < n; ++i)
+      rows[c][i] = &buffers[c][i*width];
+    ptrs[c] = &rows[c][0];
+  }
+
+  // write!
+  const size_t rowstep = status.max_v_samp_factor*DCTSIZE;
+  for (size_t k = 0; status.next_scanline < status.image_height; ++k) {
+    for (size_t c = 0; c < ncomps; ++c) {
+      const Image& plane = img.getPlane(c);
+      const size_t w = plane.getWidth();
+      const size_t h = plane.getHeight();
+      const size_t width = status.comp_info[c].width_in_blocks*DCTSIZE;
+      const size_t n = rows[c].size();
+      for (size_t i = 0; i < n; ++i) {
+        const Image::ConstRowIterator src = plane.row(std::min(k*n + i, h - 1));
+        JSAMPROW dest = rows[c][i];
+        for (size_t x = 0; x < w; ++x)
+          dest[x] = *src(x);
+        std::fill(dest + w, dest + width, dest[w - 1]);
+      }
+    }
+    jpeg_write_raw_data(&status, &ptrs[0], rowstep);
+
+    if (!notifyCallback_(status.next_scanline, status.image_height))
+      break;
+  }
+
+  // finish & clean up
+  jpeg_finish_compress(&status);
+  jpeg_destroy_compress(&status);
+
+  fclose(file);
+
+  // notify the callback that we're done
+  notifyCallback_(status.image_height, status.image_height);
+}
@@ -10,6 +10,7 @@
 #include <jpeglib.h>
 
 #include "baseio.h"
+#include "image/planarimage.h"
 
 /// This class manages input/output for JPEG files.
 class JpegIO : public BaseIO {
@@ -21,6 +22,22 @@ class JpegIO : public BaseIO {
   /// Get the header information from a JPEG.
   virtual Header inspect(const std::string& name) const;
 
+  /// The components of a JPEG, as they are stored in the file.
+  typedef PlanarImage<unsigned char> RawImage;
+  /** @brief Load the raw components of a JPEG.
+   *
+   *  The components are returned in the JPEG color space (usually YCbCr),
+   *  without color conversion and with the chroma planes still subsampled.
+   *  The size hint and the orientation tag are ignored.
+   */
+  RawImage loadRaw(const std::string& name) const;
+  /** @brief Save raw components to a JPEG.
+   *
+   *  The planes are compressed as they are, using their sampling factors; no
+   *  color conversion or downsampling is done.
+   */
+  void writeRaw(const std::string& name, const RawImage& img) const;
+
   /// Convert @a J_COLOR_SPACE to string description.
   static std::string convertColorspace(J_COLOR_SPACE space);
 
@@ -6,6 +6,10 @@
 
 #include "image.h"
 #include "imgbuffer-impl.h"
+#include "interleave.h"
+
+#include <algorithm>
+#include <stdexcept>
 
 template <class T>
 void GenericImage<T>::appendMetadatum(const std::string& tag,
@@ -48,4 +52,22 @@ Metadatum& GenericImage<T>::getMetadatum(const std::string& tag)
     return i -> second;
 }
 
+template <class T>
+void GenericImage<T>::copyPixelsFrom(const GenericImage<T>& other)
+{
+  if (other.getWidth() != getWidth() || other.getHeight() != getHeight() ||
+      other.getChannelCount() != getChannelCount())
+    throw std::runtime_error("[GenericImage::copyPixelsFrom] Image size "
+      "mismatch.");
+
+  const size_t width = getWidth();
+  const size_t ncomps = getChannelCount();
+  ConstRowIterator src = other.rowBegin();
+  for (RowIterator<T> dest = rowBegin(); dest != rowEnd(); ++dest, ++src) {
+    copyPixelRow(src.getData(), src.getPixelStride(), src.getChannelStride(),
+      dest.getData(), dest.getPixelStride(), dest.getChannelStride(), width,
+      ncomps);
+  }
+}
+
 #endif
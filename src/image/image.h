@@ -8,6 +8,7 @@
 
 #include "imgbuffer.h"
 #include "metadata.h"
+#include "rowiterator.h"
 
 /** @brief An image with metadata.
  *
@@ -34,6 +35,23 @@ class GenericImage {
   const T* getData() const { return image_.getData(); }
   /// Get direct access to the image data.
   T* getData() { return image_.getData(); }
+  /** @brief Get read-only access to the strides.
+   *
+   *  @see ImageBuffer::getStrides.
+   */
+  const int* getStrides() const { return image_.getStrides(); }
+  /** @brief Get the distance between the color channels of a pixel.
+   *
+   *  @see ImageBuffer::getChannelStride.
+   */
+  int getChannelStride() const { return image_.getChannelStride(); }
+  /// Get the way the channels are arranged in memory.
+  ImageLayout getLayout() const { return image_.getLayout(); }
+  /** @brief Convert the image data to the given layout.
+   *
+   *  @see ImageBuffer::setLayout.
+   */
+  void setLayout(ImageLayout layout) { image_.setLayout(layout); }
 
   /** @brief Access a given pixel in the data (read-only).
    *
@@ -46,6 +64,46 @@ class GenericImage {
    */
   T* operator()(size_t x, size_t y) { return image_(x, y); }
 
+  /// Read-only iterator over rows.
+  typedef RowIterator<const T> ConstRowIterator;
+
+  /** @brief Get an iterator to row @a y (read-only).
+   *
+   *  This respects strides and offsets, so it works for any view.
+   */
+  ConstRowIterator row(size_t y) const {
+    const int* strides = image_.getStrides();
+    return ConstRowIterator(image_(0, y), strides[0], strides[1],
+      image_.getWidth(), image_.getChannelCount(), image_.getChannelStride());
+  }
+  /** @brief Get an iterator to row @a y.
+   *
+   *  This respects strides and offsets, so it works for any view.
+   */
+  RowIterator<T> row(size_t y) {
+    const int* strides = image_.getStrides();
+    return RowIterator<T>(image_(0, y), strides[0], strides[1],
+      image_.getWidth(), image_.getChannelCount(), image_.getChannelStride());
+  }
+  /// Get an iterator to the first row (read-only).
+  ConstRowIterator rowBegin() const { return row(0); }
+  /// Get an iterator to the first row.
+  RowIterator<T> rowBegin() { return row(0); }
+  /// Get an iterator past the last row (read-only).
+  ConstRowIterator rowEnd() const { return row(getHeight()); }
+  /// Get an iterator past the last row.
+  RowIterator<T> rowEnd() { return row(getHeight()); }
+
+  /** @brief Check whether the pixels in each row are adjacent in memory.
+   *
+   *  This is the case for any interleaved image that was not rotated, flipped
+   *  along the x axis, or restricted to a subset of its channels.
+   */
+  bool hasContiguousRows() const {
+    return image_.getStrides()[0] == (int)image_.getChannelCount() &&
+      image_.getLayout() == LAYOUT_INTERLEAVED;
+  }
+
   /// Get width in pixels.
   size_t getWidth() const { return image_.getWidth(); }
   /// Get height in pixels.
@@ -73,8 +131,8 @@ class GenericImage {
 
   /** @brief Make sure the image data is contiguous.
    *
-   *  If the image data is already contiguous and in row-major order, nothing
-   *  happens. Otherwise, the image is put in that form.
+   *  If the image data is already contiguous, interleaved, and in row-major
+   *  order, nothing happens. Otherwise, the image is put in that form.
    */
   void flatten() { image_.flatten(); }
 
@@ -90,7 +148,7 @@ class GenericImage {
    *  @see ImageBuffer::selectChannel.
    */
   void selectChannel(size_t i)
-    { image_.selectChannel(i); image_.channel_types_ = 'k'; }
+    { image_.selectChannel(i); channel_types_ = "k"; }
 
   /** @brief Return a cropped version of the image.
    *
@@ -128,6 +186,14 @@ class GenericImage {
    */
   void flipXY() { image_.flipXY(); }
 
+  /** @brief Copy the pixel values from another image of the same size.
+   *
+   *  This respects the strides of both images, so either of them can be a
+   *  view. This is useful for writing into a region of a larger image, and
+   *  does not touch the metadata.
+   */
+  void copyPixelsFrom(const GenericImage<T>& other);
+
   //@}
 
   /// @name Members related to metadata.
@@ -221,12 +287,13 @@ class GenericImage {
   /// Get the total image data size.
   size_t getSize() { return image_.getSize(); }
 
-  /** @brief Allocate space for a new image.
+  /** @brief Allocate space for a new image, using the given layout.
    *
    *  This clears the image data if it is not already empty. It has no effect on
    *  the metadata.
    */
-  void allocate() { image_.allocate(); }
+  void allocate(ImageLayout layout = LAYOUT_INTERLEAVED)
+    { image_.allocate(layout); }
   //@}
 
   /// @name Other members.
@@ -8,8 +8,10 @@
 
 #include <algorithm>
 
+#include "interleave.h"
+
 template <class T>
-void ImageBuffer<T>::forceCopy_()
+void ImageBuffer<T>::forceCopy_(ImageLayout layout)
 {
   size_t size = getSize();
   if (size == 0) {
@@ -21,25 +23,32 @@ void ImageBuffer<T>::forceCopy_()
   T* newbuffer = new T[size];
 
   // new strides
-  int ns1 = ncomps_;
-  int ns2 = ncomps_*width_;
+  int ns1, ns2, nsc;
+  if (layout == LAYOUT_PLANAR) {
+    ns1 = 1;
+    ns2 = width_;
+    nsc = width_*height_;
+  } else {
+    ns1 = ncomps_;
+    ns2 = ncomps_*width_;
+    nsc = 1;
+  }
 
   // copy the data
   for (size_t i = 0; i < height_; ++i) {
-    for (size_t j = 0; j < width_; ++j) {
-      const T* first = ptr_ + j*strides_[0] + i*strides_[1];
-      std::copy(first, first + ncomps_, newbuffer + j*ns1 + i*ns2);
-    }
+    copyPixelRow(ptr_ + i*strides_[1], strides_[0], channelStride_,
+      newbuffer + i*ns2, ns1, nsc, width_, ncomps_);
   }
 
   // update the data pointer and the strides
   ptr_ = newbuffer;
   strides_[0] = ns1; strides_[1] = ns2;
+  channelStride_ = nsc;
   data_.reset(newbuffer);
 }
 
 template <class T>
-void ImageBuffer<T>::allocate()
+void ImageBuffer<T>::allocate(ImageLayout layout)
 {
   size_t size = getSize();
   if (size == 0)
@@ -47,8 +56,15 @@ void ImageBuffer<T>::allocate()
   else {
     data_.reset(new T[size]);
     ptr_ = data_.get();
-    strides_[0] = ncomps_;
-    strides_[1] = ncomps_*width_;
+    if (layout == LAYOUT_PLANAR) {
+      strides_[0] = 1;
+      strides_[1] = width_;
+      channelStride_ = width_*height_;
+    } else {
+      strides_[0] = ncomps_;
+      strides_[1] = ncomps_*width_;
+      channelStride_ = 1;
+    }
   }
 }
 
@@ -12,6 +12,15 @@
 /// Axis enum.
 enum ImageAxis { NO_AXIS = 0, X_AXIS, Y_AXIS, BOTH_AXES };
 
+/** @brief The way the color channels are arranged in memory.
+ *
+ *  In the interleaved layout, the channels of each pixel are adjacent; in the
+ *  planar layout, each channel is stored separately, as a contiguous
+ *  single-channel image. @a LAYOUT_ANY is never the layout of an image; it
+ *  is used by code that works equally well with either layout.
+ */
+enum ImageLayout { LAYOUT_INTERLEAVED = 0, LAYOUT_PLANAR, LAYOUT_ANY };
+
 /** @brief Image buffer featuring lazy copying.
  *
  *  This is designed to allow for fast copying when read-only access is
@@ -23,6 +32,11 @@ enum ImageAxis { NO_AXIS = 0, X_AXIS, Y_AXIS, BOTH_AXES };
  *  This class is rather agnostic of the contents of the data buffer. It can
  *  be considered a matrix of values of type @a T.
  *
+ *  By default the color channels are interleaved, but they can also be stored
+ *  in separate planes (see @a ImageLayout). Code that accesses the channels of
+ *  a pixel as @a p[k] assumes the interleaved layout; code that supports both
+ *  layouts should use @a getChannelStride.
+ *
  *  This class is meant to help in the implementation of other classes, and
  *  not to be used on its own.
  */
@@ -33,8 +47,8 @@ class ImageBuffer {
   typedef T value_type;
 
   /// Empty constructor.
-  ImageBuffer() : ptr_(0), width_(0), height_(0), ncomps_(0)
-    { strides_[0] = strides_[1] = 0; }
+  ImageBuffer() : ptr_(0), channelStride_(1), width_(0), height_(0),
+      ncomps_(0) { strides_[0] = strides_[1] = 0; }
 
   /// Get direct access to the data (read-only).
   const T* getData() const { return data_.get(); }
@@ -42,6 +56,17 @@ class ImageBuffer {
   T* getData() { return data_.get(); }
   /// Get read-only access to the strides.
   const int* getStrides() const { return strides_; }
+  /** @brief Get the distance between the color channels of a pixel.
+   *
+   *  Channel @a k of pixel (x, y) is at (*this)(x, y)[k*getChannelStride()].
+   *  This is 1 for interleaved images.
+   */
+  int getChannelStride() const { return channelStride_; }
+  /// Get the way the channels are arranged in memory.
+  ImageLayout getLayout() const {
+    return (ncomps_ > 1 && channelStride_ != 1)?LAYOUT_PLANAR:
+      LAYOUT_INTERLEAVED;
+  }
 
   /** @brief Access a given pixel in the data (read-only).
    *
@@ -86,13 +111,29 @@ class ImageBuffer {
 
   /** @brief Make sure the image data is contiguous.
    *
-   *  If the image data is already contiguous and in row-major order, nothing
-   *  happens. Otherwise, the image is put in that form.
+   *  If the image data is already contiguous, interleaved, and in row-major
+   *  order, nothing happens. Otherwise, the image is put in that form.
    */
   void flatten() {
     if (!isEmpty() && (strides_[0] != (int)ncomps_
-        || strides_[1] != (int)(ncomps_*width_)))
-      forceCopy_();
+        || strides_[1] != (int)(ncomps_*width_)
+        || getLayout() != LAYOUT_INTERLEAVED))
+      forceCopy_(LAYOUT_INTERLEAVED);
+  }
+  /** @brief Convert the image data to the given layout.
+   *
+   *  This makes a contiguous, row-major copy of the data in the new layout,
+   *  unless the image is already in that form. Converting to
+   *  @a LAYOUT_INTERLEAVED is the same as @a flatten; @a LAYOUT_ANY does
+   *  nothing.
+   */
+  void setLayout(ImageLayout layout) {
+    if (layout == LAYOUT_INTERLEAVED)
+      flatten();
+    else if (layout == LAYOUT_PLANAR && !isEmpty() && (strides_[0] != 1
+        || strides_[1] != (int)width_
+        || (ncomps_ > 1 && channelStride_ != (int)(width_*height_))))
+      forceCopy_(LAYOUT_PLANAR);
   }
 
   /// Make a deep copy of the image.
@@ -103,9 +144,9 @@ class ImageBuffer {
    *  If the image is empty, or the reference count of the data is 1, nothing
    *  is done. Otherwise a copy of the image data is made in a newly-allocated
    *  buffer. This also has the effect that the image data is contiguous and
-   *  in row-major order after the call.
+   *  in row-major order after the call. The layout is preserved.
    */
-  void makeUnique() { if (!isUnique()) forceCopy_(); }
+  void makeUnique() { if (!isUnique()) forceCopy_(getLayout()); }
   /// Returns @a true if the image contains no data.
   bool isEmpty() const { return ptr_ == 0; }
   /** @brief Returns @a true if the image doesn't share its data with any other.
@@ -120,11 +161,11 @@ class ImageBuffer {
   /// Get total image size.
   size_t getSize() { return ncomps_*width_*height_; }
 
-  /** @brief Allocate space for a new image.
+  /** @brief Allocate space for a new image, using the given layout.
    *
    *  This clears the image if it is not already empty.
    */
-  void allocate();
+  void allocate(ImageLayout layout = LAYOUT_INTERLEAVED);
 
   /** @brief Crop the image.
    *
@@ -173,7 +214,7 @@ class ImageBuffer {
    *  an actual copy of the data. This means that cropping is fast, and the
    *  image still points to the same image data.
    */
-  void selectChannel(size_t i) { ptr_ += i; ncomps_ = 1; }
+  void selectChannel(size_t i) { ptr_ += i*channelStride_; ncomps_ = 1; }
   /** @brief Get a grayscale image corresponding to one of the channels.
    *
    *  Note that this only makes a shallow copy, i.e., the result and the 
@@ -185,8 +226,8 @@ class ImageBuffer {
     { ImageBuffer<T> res(*this); res.selectChannel(i); return res; }
 
  private:
-  /// Force a copy of the image data to be made.
-  void forceCopy_();
+  /// Force a copy of the image data to be made, using the given layout.
+  void forceCopy_(ImageLayout layout);
 
   /// Reference-counted pointer to the data.
   boost::shared_array<T>    data_;
@@ -203,6 +244,8 @@ class ImageBuffer {
    *  to easily take subsets of a picture without performing a copy.
    */
   int                       strides_[2];
+  /// Distance between the color channels of a pixel.
+  int                       channelStride_;
   /// Number of pixels in the x direction.
   size_t                    width_;
   /// Number of pixels in the y direction.
@@ -0,0 +1,164 @@
+/** @file interleave.h
+ *  @brief Kernels for copying rows of pixels between interleaved and planar
+ *         layouts.
+ */
+#ifndef IMAGE_INTERLEAVE_H_
+#define IMAGE_INTERLEAVE_H_
+
+#include <algorithm>
+#include <cstddef>
+
+#include "misc/cpudispatch.h"
+
+namespace interleave_detail {
+
+// the channel count is a template parameter so that the compiler can unroll
+// the inner loop and vectorize the outer one
+
+template <size_t N, class T>
+inline void interleave(const T* src, int channelStride, size_t width, T* dest)
+{
+  for (size_t x = 0; x < width; ++x)
+    for (size_t k = 0; k < N; ++k)
+      dest[N*x + k] = src[k*channelStride + x];
+}
+
+template <size_t N, class T>
+inline void deinterleave(const T* src, size_t width, T* dest, int channelStride)
+{
+  for (size_t x = 0; x < width; ++x)
+    for (size_t k = 0; k < N; ++k)
+      dest[k*channelStride + x] = src[N*x + k];
+}
+
+template <class T>
+inline void interleaveRow(const T* src, int channelStride, size_t width,
+    size_t ncomps, T* dest)
+{
+  switch (ncomps) {
+    case 1: std::copy(src, src + width, dest); break;
+    case 2: interleave<2>(src, channelStride, width, dest); break;
+    case 3: interleave<3>(src, channelStride, width, dest); break;
+    case 4: interleave<4>(src, channelStride, width, dest); break;
+    default:
+      for (size_t x = 0; x < width; ++x)
+        for (size_t k = 0; k < ncomps; ++k)
+          dest[ncomps*x + k] = src[k*channelStride + x];
+  }
+}
+
+template <class T>
+LAPSE_TARGET_AVX2 void interleaveRowAvx2(const T* src, int channelStride,
+    size_t width, size_t ncomps, T* dest)
+{
+  interleaveRow(src, channelStride, width, ncomps, dest);
+}
+
+template <class T>
+LAPSE_TARGET_AVX512 void interleaveRowAvx512(const T* src, int channelStride,
+    size_t width, size_t ncomps, T* dest)
+{
+  interleaveRow(src, channelStride, width, ncomps, dest);
+}
+
+template <class T>
+inline void deinterleaveRow(const T* src, size_t width, size_t ncomps, T* dest,
+    int channelStride)
+{
+  switch (ncomps) {
+    case 1: std::copy(src, src + width, dest); break;
+    case 2: deinterleave<2>(src, width, dest, channelStride); break;
+    case 3: deinterleave<3>(src, width, dest, channelStride); break;
+    case 4: deinterleave<4>(src, width, dest, channelStride); break;
+    default:
+      for (size_t x = 0; x < width; ++x)
+        for (size_t k = 0; k < ncomps; ++k)
+          dest[k*channelStride + x] = src[ncomps*x + k];
+  }
+}
+
+template <class T>
+LAPSE_TARGET_AVX2 void deinterleaveRowAvx2(const T* src, size_t width,
+    size_t ncomps, T* dest, int channelStride)
+{
+  deinterleaveRow(src, width, ncomps, dest, channelStride);
+}
+
+template <class T>
+LAPSE_TARGET_AVX512 void deinterleaveRowAvx512(const T* src, size_t width,
+    size_t ncomps, T* dest, int channelStride)
+{
+  deinterleaveRow(src, width, ncomps, dest, channelStride);
+}
+
+} // namespace interleave_detail
+
+/** @brief Interleave a row of planar pixels.
+ *
+ *  The channels of the source are @a channelStride elements apart, and the
+ *  pixels within a channel are adjacent. The output is written as
+ *  @a width pixels of @a ncomps adjacent channels each.
+ *
+ *  The kernel is chosen according to the CPU (see @a CpuDispatch).
+ */
+template <class T>
+void interleaveRow(const T* src, int channelStride, size_t width,
+    size_t ncomps, T* dest)
+{
+  typedef void (*Kernel)(const T*, int, size_t, size_t, T*);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &interleave_detail::interleaveRow<T>,
+    &interleave_detail::interleaveRowAvx2<T>,
+    &interleave_detail::interleaveRowAvx512<T>);
+  kernel(src, channelStride, width, ncomps, dest);
+}
+
+/** @brief Split a row of interleaved pixels into planes.
+ *
+ *  This is the inverse of @a interleaveRow.
+ */
+template <class T>
+void deinterleaveRow(const T* src, size_t width, size_t ncomps, T* dest,
+    int channelStride)
+{
+  typedef void (*Kernel)(const T*, size_t, size_t, T*, int);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &interleave_detail::deinterleaveRow<T>,
+    &interleave_detail::deinterleaveRowAvx2<T>,
+    &interleave_detail::deinterleaveRowAvx512<T>);
+  kernel(src, width, ncomps, dest, channelStride);
+}
+
+/** @brief Copy a row of pixels between arbitrary layouts.
+ *
+ *  Channel @a k of pixel @a x is at @a src[x*srcPixelStride +
+ *  k*srcChannelStride], and similarly for the destination. Copies between
+ *  interleaved rows, and between an interleaved and a planar row, use the
+ *  fast kernels; anything else is copied element by element.
+ */
+template <class T>
+void copyPixelRow(const T* src, int srcPixelStride, int srcChannelStride,
+    T* dest, int destPixelStride, int destChannelStride, size_t width,
+    size_t ncomps)
+{
+  const bool srcInterleaved = (srcPixelStride == (int)ncomps &&
+    (ncomps == 1 || srcChannelStride == 1));
+  const bool destInterleaved = (destPixelStride == (int)ncomps &&
+    (ncomps == 1 || destChannelStride == 1));
+  if (srcInterleaved && destInterleaved) {
+    std::copy(src, src + width*ncomps, dest);
+  } else if (srcInterleaved && destPixelStride == 1) {
+    deinterleaveRow(src, width, ncomps, dest, destChannelStride);
+  } else if (srcPixelStride == 1 && destInterleaved) {
+    interleaveRow(src, srcChannelStride, width, ncomps, dest);
+  } else {
+    for (size_t x = 0; x < width; ++x) {
+      const T* p = src + x*srcPixelStride;
+      T* q = dest + x*destPixelStride;
+      for (size_t k = 0; k < ncomps; ++k)
+        q[k*destChannelStride] = p[k*srcChannelStride];
+    }
+  }
+}
+
+#endif
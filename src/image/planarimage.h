@@ -0,0 +1,119 @@
+/** @file planarimage.h
+ *  @brief An image stored as separate planes, possibly at different
+ *         resolutions.
+ */
+#ifndef IMAGE_PLANARIMAGE_H_
+#define IMAGE_PLANARIMAGE_H_
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+/** @brief An image stored as a set of single-channel planes, each at its own
+ *         resolution.
+ *
+ *  This is the way JPEG files store their components: typically the chroma
+ *  planes of a YCbCr image have half the resolution of the luma plane in one
+ *  or both directions. Each plane is a @a GenericImage, so it can be a view,
+ *  like any other image.
+ *
+ *  The resolution of each plane is given by its sampling factors, following
+ *  the JPEG conventions: a plane with sampling factors (h, v) has size
+ *  ceil(width*h/hmax) x ceil(height*v/vmax), where hmax and vmax are the
+ *  largest sampling factors of all the planes.
+ *
+ *  The metadata of the image is stored with the first plane.
+ */
+template <class T>
+class PlanarImage {
+ public:
+  /// Type of elements stored by the image.
+  typedef T value_type;
+  /// Type used for each plane.
+  typedef GenericImage<T> Plane;
+
+  /// Sampling factors for a plane.
+  struct Sampling {
+    int h;
+    int v;
+  };
+
+  /// Constructor.
+  PlanarImage() : width_(0), height_(0) {}
+
+  /// Get width of the full-resolution image.
+  size_t getWidth() const { return width_; }
+  /// Get height of the full-resolution image.
+  size_t getHeight() const { return height_; }
+  /** @brief Set the size of the full-resolution image.
+   *
+   *  This does not change the planes; use @a getPlaneWidth and
+   *  @a getPlaneHeight to find the sizes they should have.
+   */
+  void reshape(size_t width, size_t height)
+    { width_ = width; height_ = height; }
+
+  /** @brief Get a string describing the types of the color channels.
+   *
+   *  This uses the same codes as @a GenericImage::getChannelTypes, with one
+   *  character per plane.
+   */
+  const std::string& getChannelTypes() const { return channel_types_; }
+  /// Set the types of the color channels.
+  void setChannelTypes(const std::string& s) { channel_types_ = s; }
+
+  /// Add a plane with the given sampling factors.
+  void addPlane(const Plane& plane, const Sampling& sampling) {
+    planes_.push_back(plane);
+    sampling_.push_back(sampling);
+  }
+  /// Get the number of planes.
+  size_t getPlaneCount() const { return planes_.size(); }
+  /// Access a plane (read-only).
+  const Plane& getPlane(size_t i) const { return planes_[i]; }
+  /// Access a plane.
+  Plane& getPlane(size_t i) { return planes_[i]; }
+  /// Get the sampling factors of a plane.
+  const Sampling& getSampling(size_t i) const { return sampling_[i]; }
+
+  /// Get the largest horizontal and vertical sampling factors.
+  Sampling getMaxSampling() const {
+    Sampling res = {1, 1};
+    for (size_t i = 0; i < sampling_.size(); ++i) {
+      if (sampling_[i].h > res.h) res.h = sampling_[i].h;
+      if (sampling_[i].v > res.v) res.v = sampling_[i].v;
+    }
+    return res;
+  }
+  /// Width that plane @a i should have, given the full-resolution @a width.
+  size_t getPlaneWidth(size_t i, size_t width) const {
+    const size_t hmax = getMaxSampling().h;
+    return (width*sampling_[i].h + hmax - 1)/hmax;
+  }
+  /// Height that plane @a i should have, given the full-resolution @a height.
+  size_t getPlaneHeight(size_t i, size_t height) const {
+    const size_t vmax = getMaxSampling().v;
+    return (height*sampling_[i].v + vmax - 1)/vmax;
+  }
+
+  /// Check that the plane sizes are consistent with the image size.
+  void check() const {
+    for (size_t i = 0; i < planes_.size(); ++i) {
+      if (planes_[i].getWidth() != getPlaneWidth(i, width_) ||
+          planes_[i].getHeight() != getPlaneHeight(i, height_))
+        throw std::runtime_error("[PlanarImage::check] Plane size does not "
+          "match image size and sampling factors.");
+    }
+  }
+
+ private:
+  std::vector<Plane>      planes_;
+  std::vector<Sampling>   sampling_;
+  size_t                  width_;
+  size_t                  height_;
+  std::string             channel_types_;
+};
+
+#endif
@@ -0,0 +1,175 @@
+/** @file quantize.h
+ *  @brief Conversion of floating point values to pixel values.
+ */
+#ifndef IMAGE_QUANTIZE_H_
+#define IMAGE_QUANTIZE_H_
+
+#include <algorithm>
+#include <limits>
+
+#include <stdint.h>
+
+#include "misc/cpudispatch.h"
+
+namespace quantize_detail {
+
+/** @brief Type through which floats are converted to @a T.
+ *
+ *  Conversions to a 32-bit integer vectorize well, while those straight to
+ *  smaller or unsigned types don't.
+ */
+template <class T> struct Intermediate { typedef T type; };
+template <> struct Intermediate<unsigned char> { typedef int32_t type; };
+template <> struct Intermediate<signed char> { typedef int32_t type; };
+template <> struct Intermediate<unsigned short> { typedef int32_t type; };
+template <> struct Intermediate<short> { typedef int32_t type; };
+
+template <class T, bool Integer = std::numeric_limits<T>::is_integer>
+struct Quantizer {
+  // floating point values are kept as they are
+  static T get(float x) { return x; }
+};
+
+template <class T>
+struct Quantizer<T, true> {
+  static T get(float x) {
+    typedef typename Intermediate<T>::type I;
+    const float lo = std::numeric_limits<T>::min();
+    const float hi = std::numeric_limits<T>::max();
+    // written so that NaNs go to lo, and so that the compiler can use
+    // min/max instructions
+    x = (lo < x)?x:lo;
+    x = (x < hi)?x:hi;
+    // rounding half away from zero; for unsigned types the check is a no-op
+    return (T)(I)(x + ((x < 0)?-0.5f:0.5f));
+  }
+};
+
+/// 8x8 Bayer matrix, for ordered dithering.
+const unsigned char bayer8[8][8] = {
+  { 0, 32,  8, 40,  2, 34, 10, 42},
+  {48, 16, 56, 24, 50, 18, 58, 26},
+  {12, 44,  4, 36, 14, 46,  6, 38},
+  {60, 28, 52, 20, 62, 30, 54, 22},
+  { 3, 35, 11, 43,  1, 33,  9, 41},
+  {51, 19, 59, 27, 49, 17, 57, 25},
+  {15, 47,  7, 39, 13, 45,  5, 37},
+  {63, 31, 55, 23, 61, 29, 53, 21}};
+
+inline float ditherOffset(size_t x, size_t y)
+{
+  return (bayer8[y % 8][x % 8] + 0.5f)/64 - 0.5f;
+}
+
+template <class T>
+inline void quantizeRow(const float* src, size_t n, T* dest)
+{
+  for (size_t i = 0; i < n; ++i)
+    dest[i] = Quantizer<T>::get(src[i]);
+}
+
+template <class T>
+LAPSE_TARGET_AVX2 void quantizeRowAvx2(const float* src, size_t n, T* dest)
+{
+  quantizeRow(src, n, dest);
+}
+
+template <class T>
+LAPSE_TARGET_AVX512 void quantizeRowAvx512(const float* src, size_t n,
+    T* dest)
+{
+  quantizeRow(src, n, dest);
+}
+
+template <class T>
+inline void quantizeRowDithered(const float* src, size_t width, size_t ncomps,
+    T* dest, size_t x0, size_t y)
+{
+  // the pattern repeats every 8 pixels, so the offsets for one period are
+  // worked out once
+  float offsets[8];
+  for (size_t i = 0; i < 8; ++i)
+    offsets[i] = ditherOffset(x0 + i, y);
+  for (size_t x = 0; x < width; ++x) {
+    const float d = offsets[x % 8];
+    for (size_t k = 0; k < ncomps; ++k)
+      dest[x*ncomps + k] = Quantizer<T>::get(src[x*ncomps + k] + d);
+  }
+}
+
+template <class T>
+LAPSE_TARGET_AVX2 void quantizeRowDitheredAvx2(const float* src, size_t width,
+    size_t ncomps, T* dest, size_t x0, size_t y)
+{
+  quantizeRowDithered(src, width, ncomps, dest, x0, y);
+}
+
+template <class T>
+LAPSE_TARGET_AVX512 void quantizeRowDitheredAvx512(const float* src,
+    size_t width, size_t ncomps, T* dest, size_t x0, size_t y)
+{
+  quantizeRowDithered(src, width, ncomps, dest, x0, y);
+}
+
+} // namespace quantize_detail
+
+/** @brief Convert a value to type @a T.
+ *
+ *  For integer types, the value is rounded to nearest and saturated to the
+ *  range of the type, with NaNs going to the minimum. Floating point values
+ *  are passed through unchanged.
+ */
+template <class T>
+inline T quantize(float x)
+{
+  return quantize_detail::Quantizer<T>::get(x);
+}
+
+/** @brief Get the ordered dither offset for pixel (@a x, @a y).
+ *
+ *  The offsets come from an 8x8 Bayer matrix, and are evenly spread over
+ *  (-0.5, 0.5), so adding them before rounding turns smooth gradients into
+ *  a fine pattern of neighboring levels rather than visible bands.
+ */
+inline float ditherOffset(size_t x, size_t y)
+{
+  return quantize_detail::ditherOffset(x, y);
+}
+
+/** @brief Convert a row of @a n floats to type @a T, like @a quantize.
+ *
+ *  The kernel is chosen according to the CPU (see @a CpuDispatch).
+ */
+template <class T>
+void quantizeRow(const float* src, size_t n, T* dest)
+{
+  typedef void (*Kernel)(const float*, size_t, T*);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &quantize_detail::quantizeRow<T>,
+    &quantize_detail::quantizeRowAvx2<T>,
+    &quantize_detail::quantizeRowAvx512<T>);
+  kernel(src, n, dest);
+}
+
+/** @brief Convert a row of interleaved pixels to type @a T, with ordered
+ *         dithering.
+ *
+ *  The row has @a width pixels of @a ncomps channels, and starts at pixel
+ *  (@a x0, @a y) of the image. All the channels of a pixel get the same
+ *  offset (see @a ditherOffset), so the dither changes brightness rather
+ *  than hue. This is meant for integer types; floating point values would
+ *  just get the offsets added.
+ */
+template <class T>
+void quantizeRowDithered(const float* src, size_t width, size_t ncomps,
+    T* dest, size_t x0, size_t y)
+{
+  typedef void (*Kernel)(const float*, size_t, size_t, T*, size_t, size_t);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &quantize_detail::quantizeRowDithered<T>,
+    &quantize_detail::quantizeRowDitheredAvx2<T>,
+    &quantize_detail::quantizeRowDitheredAvx512<T>);
+  kernel(src, width, ncomps, dest, x0, y);
+}
+
+#endif
@@ -0,0 +1,84 @@
+/** @file rowiterator.h
+ *  @brief An iterator over the rows of an image, respecting strides.
+ */
+#ifndef IMAGE_ROWITERATOR_H_
+#define IMAGE_ROWITERATOR_H_
+
+#include <cstddef>
+
+/** @brief Iterator over the rows of an image.
+ *
+ *  Images can be views into larger buffers (crops, rotations, flips, channel
+ *  selections), so neither the pixels in a row nor the rows themselves need
+ *  to be adjacent in memory. This iterator hides the strides: dereferencing
+ *  it gives access to the current row, and incrementing it moves to the next
+ *  row.
+ *
+ *  Use @a T = const U for read-only access.
+ */
+template <class T>
+class RowIterator {
+ public:
+  /// Type of elements in the row.
+  typedef T value_type;
+
+  /// Constructor.
+  RowIterator(T* ptr, int pixelStride, int rowStride, size_t width,
+      size_t ncomps, int channelStride = 1) : ptr_(ptr),
+      pixelStride_(pixelStride), rowStride_(rowStride),
+      channelStride_(channelStride), width_(width), ncomps_(ncomps) {}
+
+  /// Get a pointer to the first color component of pixel @a x in the row.
+  T* operator()(size_t x) const { return ptr_ + pixelStride_*x; }
+  /// Get a pointer to the start of the row.
+  T* getData() const { return ptr_; }
+  /** @brief Get a pointer to channel @a k of the first pixel in the row.
+   *
+   *  The other pixels of that channel are @a getPixelStride() elements apart.
+   *  For planar images, this is a contiguous array.
+   */
+  T* channel(size_t k) const { return ptr_ + channelStride_*k; }
+
+  /// Get the number of pixels in the row.
+  size_t getWidth() const { return width_; }
+  /// Get the number of color channels per pixel.
+  size_t getChannelCount() const { return ncomps_; }
+  /// Get the distance, in elements, between consecutive pixels.
+  int getPixelStride() const { return pixelStride_; }
+  /// Get the distance, in elements, between the channels of a pixel.
+  int getChannelStride() const { return channelStride_; }
+
+  /** @brief Check whether the row is contiguous in memory.
+   *
+   *  When this is true, the row can be treated as a simple array of
+   *  @a getWidth()*@a getChannelCount() interleaved elements starting at
+   *  @a getData().
+   */
+  bool isContiguous() const {
+    return pixelStride_ == (int)ncomps_ && (ncomps_ == 1 ||
+      channelStride_ == 1);
+  }
+
+  /// Move to the next row.
+  RowIterator& operator++() { ptr_ += rowStride_; return *this; }
+  /// Move to the next row.
+  RowIterator operator++(int)
+    { RowIterator res(*this); ptr_ += rowStride_; return res; }
+  /// Move forward by @a n rows.
+  RowIterator& operator+=(ptrdiff_t n) { ptr_ += rowStride_*n; return *this; }
+
+  /// Compare row positions.
+  bool operator==(const RowIterator& other) const { return ptr_ == other.ptr_; }
+  /// Compare row positions.
+  bool operator!=(const RowIterator& other) const { return ptr_ != other.ptr_; }
+
+ private:
+  T*        ptr_;
+  int       pixelStride_;
+  int       rowStride_;
+  int       channelStride_;
+  size_t    width_;
+  size_t    ncomps_;
+};
+
+#endif
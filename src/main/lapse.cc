@@ -36,6 +36,29 @@ void setup_options(po::options_description& options)
       "list of keyframed effects to be executed")
     ("effects-file,f", po::value<std::string>(),
       "get list of effects from file")
+    ("reorder", "crop before the color conversion and the pointwise effects "
+      "when this gives the same result")
+    ("reorder-downscale", "like --reorder, but also downscale before the "
+      "pointwise effects (faster, but only approximately the same result)")
+    ("native-ycc", "if all effects are crops and resizes, work directly on "
+      "the JPEG components, without converting to RGB")
+    ("depth", po::value<int>() -> default_value(8),
+      "bits per channel used while processing (8 or 16); with 16, frames are "
+      "only rounded to 8 bits when they are written")
+    ("no-frame-reuse", "process every frame, even those that are the same "
+      "as an earlier one (same input and properties) instead of linking to "
+      "its output")
+    ("progress", "report the rate of processing and the time left on "
+      "standard error; this is updated in place on a terminal, and written "
+      "as key=value lines every 10 seconds otherwise")
+    ("perf-counters", "count CPU cycles, instructions, cache misses, branch "
+      "misses and page faults in each stage of the processing (Linux only)")
+    ("trace", po::value<std::string>(),
+      "write the time spent in each stage of the processing to a file, in "
+      "the Chrome trace-event format (for Perfetto or chrome://tracing)")
+    ("export-timeline", po::value<std::string>(),
+      "write the properties of the effects for every frame to a file, as "
+      "tab-separated text")
     ("output,o", po::value<std::string>(),
       "format for output files, in the form [path/]nameXXXX.ext; the X's will "
       "be replaced with numbers from 0 to the total number of frames minus 1.");
@@ -263,9 +286,30 @@ int main(int argc, const char* argv[])
   processor.set_verbosity(params.count("quiet")?0:
     params["verbosity"].as<int>());
   processor.set_output(params["output"].as<std::string>());
+  processor.set_reorder(params.count("reorder") || params.count(
+    "reorder-downscale"));
+  processor.set_reorder_downscale(params.count("reorder-downscale"));
+  processor.set_native_ycc(params.count("native-ycc"));
+  processor.set_depth(params["depth"].as<int>());
+  processor.set_reuse_frames(!params.count("no-frame-reuse"));
+  processor.set_progress(params.count("progress"));
+  processor.set_perf_counters(params.count("perf-counters"));
+  if (params.count("trace"))
+    processor.set_trace(params["trace"].as<std::string>());
   processor.add_files(file_names);
   processor.parse_effects(effects_str);
 
+  if (params.count("export-timeline")) {
+    const std::string name = params["export-timeline"].as<std::string>();
+    std::ofstream f(name.c_str());
+    processor.get_timeline().write(f);
+    if (!f) {
+      std::cerr << "Could not write the timeline to " << name << "."
+                << std::endl;
+      return 1;
+    }
+  }
+
   processor.run();
 
 #ifdef __APPLE__
@@ -0,0 +1,133 @@
+#include "planner.h"
+
+#include "effects/cropresize.h"
+#include "effects/transform.h"
+
+namespace {
+
+bool is_pointwise(const std::string& name)
+{
+  return name == icc_step_name ||
+    EffectFactory::get_instance() -> is_pointwise(name);
+}
+
+// update the image size after a step
+void update_size(const Step& step, size_t& width, size_t& height)
+{
+  const std::pair<size_t, size_t> size = EffectFactory::get_instance() ->
+    get_output_size(step.name, step.properties, width, height);
+  width = size.first;
+  height = size.second;
+}
+
+// split the properties of a cropresize step into crop and resize parts
+void split_cropresize(const Step& step, Step& crop, Step& resize)
+{
+  crop.name = resize.name = step.name;
+  crop.properties.clear();
+  resize.properties.clear();
+  for (auto prop: step.properties) {
+    if (prop.first == "twidth" || prop.first == "theight" ||
+        prop.first == "prereduce")
+      resize.properties.insert(prop);
+    else
+      crop.properties.insert(prop);
+  }
+}
+
+} // anonymous namespace
+
+size_t Planner::count_pointwise(const Steps& steps, size_t width,
+    size_t height)
+{
+  size_t total = 0;
+  for (const Step& step: steps) {
+    if (is_pointwise(step.name))
+      total += width*height;
+    update_size(step, width, height);
+  }
+
+  return total;
+}
+
+Steps Planner::plan(const Steps& steps, size_t width, size_t height,
+    Stats* stats) const
+{
+  Steps result;
+  // steps before this position are never moved again; everything after it
+  // is pointwise
+  size_t insert = 0;
+  // the image size at the insertion point
+  size_t w = width;
+  size_t h = height;
+  // the image size before the last step that wasn't pointwise
+  size_t prev_w = width;
+  size_t prev_h = height;
+  for (const Step& step: steps) {
+    if (is_pointwise(step.name)) {
+      result.push_back(step);
+      continue;
+    }
+    if (step.name == "cropresize" && insert == result.size() &&
+        insert > 0 && result.back().name == "transform" &&
+        (step.properties.count("prereduce") == 0 ||
+         step.properties.at("prereduce") == 0)) {
+      // crop and resize in the same pass as the transform (which has no
+      // pre-reduction, so a crop that asks for one is left alone)
+      Step& transform = result.back();
+      transform.properties = TransformEffect::fuse_cropresize(
+        transform.properties, step.properties, prev_w, prev_h);
+      w = prev_w;
+      h = prev_h;
+      update_size(transform, w, h);
+      continue;
+    }
+    if (step.name != "cropresize" || insert == result.size()) {
+      // nothing to gain from reordering
+      result.push_back(step);
+      insert = result.size();
+      prev_w = w;
+      prev_h = h;
+      update_size(step, w, h);
+      continue;
+    }
+
+    // pointwise steps don't change the image size, so the geometry is the
+    // same as at the insertion point
+    const CropResizeEffect::Geometry geom = CropResizeEffect::get_geometry(
+      step.properties, w, h);
+    const bool downscale = (geom.width <= geom.x1 - geom.x0 &&
+      geom.height <= geom.y1 - geom.y0);
+    if (!geom.resizes() || (downscale && hoist_downscale_)) {
+      result.insert(result.begin() + insert, step);
+      ++insert;
+    } else if (geom.fractional()) {
+      // a sub-pixel crop resamples the image, so it can't be moved
+      result.push_back(step);
+      insert = result.size();
+      prev_w = w;
+      prev_h = h;
+    } else {
+      // the crop is exact, so move it; the resize stays in place
+      Step crop, resize;
+      split_cropresize(step, crop, resize);
+      if (geom.crops(w, h)) {
+        result.insert(result.begin() + insert, crop);
+        ++insert;
+      }
+      result.push_back(resize);
+      insert = result.size();
+      prev_w = geom.x1 - geom.x0;
+      prev_h = geom.y1 - geom.y0;
+    }
+    w = geom.width;
+    h = geom.height;
+  }
+
+  if (stats) {
+    stats -> pixels_before = count_pointwise(steps, width, height);
+    stats -> pixels_after = count_pointwise(result, width, height);
+  }
+
+  return result;
+}
@@ -0,0 +1,81 @@
+/** @file planner.h
+ *  @brief Reorders the effects applied to a frame to reduce the amount of
+ *         work.
+ */
+#ifndef LAPSE_PLANNER_H_
+#define LAPSE_PLANNER_H_
+
+#include <string>
+#include <vector>
+
+#include "effects/effectfactory.h"
+
+/// Name of the step converting from the embedded ICC profile to sRGB.
+const char icc_step_name[] = "icc";
+
+/// One step in the processing of a frame.
+struct Step {
+  /// Name of the effect.
+  std::string   name;
+  /// The properties for the effect, interpolated for the current frame.
+  PropertyMap   properties;
+};
+/// The list of steps to be applied to a frame, in order.
+typedef std::vector<Step> Steps;
+
+/** @brief Reorders the steps for a frame so that cropping and downscaling
+ *         happen before the expensive color work.
+ *
+ *  Pointwise effects (see @a EffectFactory::is_pointwise) and the conversion
+ *  from the embedded ICC profile commute with cropping, so a crop that is
+ *  only preceded by such steps can be done first without changing the
+ *  result. Downscaling commutes with them only approximately (clamping and
+ *  non-linear color transforms don't commute with averaging), so it is only
+ *  moved if @a set_hoist_downscale is turned on.
+ *
+ *  A crop/resize that directly follows a transform is folded into it, so
+ *  that the image is only resampled once.
+ */
+class Planner {
+ public:
+  /// Work statistics, measured in pixels processed by pointwise steps.
+  struct Stats {
+    Stats() : pixels_before(0), pixels_after(0) {}
+
+    /// Pixels processed in the original order.
+    size_t  pixels_before;
+    /// Pixels processed in the planned order.
+    size_t  pixels_after;
+
+    /// Accumulate statistics.
+    Stats& operator+=(const Stats& other) {
+      pixels_before += other.pixels_before;
+      pixels_after += other.pixels_after;
+      return *this;
+    }
+  };
+
+  Planner() : hoist_downscale_(false) {}
+
+  /// Set whether downscaling is also moved ahead of the pointwise steps.
+  void set_hoist_downscale(bool b) { hoist_downscale_ = b; }
+  /// Get whether downscaling is also moved ahead of the pointwise steps.
+  bool get_hoist_downscale() const { return hoist_downscale_; }
+
+  /** @brief Reorder the @a steps for a frame of size @a width x @a height.
+   *
+   *  If @a stats is not null, it is filled with the amount of pointwise work
+   *  before and after the reordering.
+   */
+  Steps plan(const Steps& steps, size_t width, size_t height,
+    Stats* stats = 0) const;
+
+  /// Count the pixels processed by pointwise steps.
+  static size_t count_pointwise(const Steps& steps, size_t width,
+    size_t height);
+
+ private:
+  bool  hoist_downscale_;
+};
+
+#endif
@@ -1,16 +1,35 @@
 #include "processor.h"
 
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <sstream>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "color/profilefactory.h"
-#include "color/transformfactory.h"
+#include "color/transformcache.h"
+#include "effects/cropresize.h"
 #include "effects/effectfactory.h"
 #include "file/jpeg.h"
 #include "image/image-impl.h"
+#include "image/interleave.h"
+#include "image/quantize.h"
+#include "misc/cpudispatch.h"
+#include "misc/perfcounters.h"
+#include "misc/threadpool.h"
+#include "misc/timer.h"
+#include "misc/trace.h"
+#include "progress.h"
 
 typedef JpegIO::Image Image8;
 
@@ -34,12 +53,356 @@ std::string get_prop_part(const std::string& s)
   return s.substr(dpos + 1);
 }
 
-// simple implementation for C++11's prev
-template <class It>
-It prev_it(It i)
+// the conversion from the embedded ICC profile to sRGB, as an effect; the
+// transforms are kept for as long as the frames have the same profile
+class IccEffect : public Effect {
+ public:
+  explicit IccEffect(const ColorProfile& sRGB) : sRGB_(sRGB) {}
+
+  virtual void apply(Image8& image, int) { convert_(image, image); }
+  virtual void apply(Image16& image, int) { convert_(image, image); }
+
+  virtual bool can_render() const { return true; }
+  virtual bool render(const Image8& image, Image8& target, int)
+    { convert_(image, target); return true; }
+  virtual bool render(const Image16& image, Image16& target, int)
+    { convert_(image, target); return true; }
+
+ private:
+  // convert from the embedded ICC profile to sRGB, writing into target
+  template <class T>
+  void convert_(const GenericImage<T>& image, GenericImage<T>& target) {
+    const Blob& icc = image.getMetadatum("icc").blob;
+    if (!transforms_ || icc != icc_) {
+      // get the profile of the image
+      ColorProfile profile = ColorProfileFactory::fromMemory(icc.begin(),
+        icc.end());
+      transforms_.reset(new ColorTransformCache(profile, sRGB_));
+      icc_ = icc;
+    }
+
+    // apply the transform to the image
+    transforms_ -> get(image, target).apply(image, target);
+  }
+
+  ColorProfile                              sRGB_;
+  Blob                                      icc_;
+  boost::shared_ptr<ColorTransformCache>    transforms_;
+};
+
+// the effect objects used in a run: there is one for each occurrence of each
+// effect in the steps, kept from one frame to the next so that it can reuse
+// whatever it built for the previous frames, and prepared when first needed
+class EffectInstances {
+ public:
+  EffectInstances(const Effects& effects, const ColorProfile& sRGB)
+    : effects_(effects), sRGB_(sRGB) {}
+
+  // get the effects for the steps of a frame
+  std::vector<Effect*> get(const Steps& steps, const FrameGeometry& geometry);
+
+ private:
+  const Effects&    effects_;
+  ColorProfile      sRGB_;
+  std::map<std::string, boost::shared_ptr<Effect> >  instances_;
+};
+
+std::vector<Effect*> EffectInstances::get(const Steps& steps,
+    const FrameGeometry& geometry)
+{
+  std::vector<Effect*> effects;
+  std::map<std::string, size_t> occurrences;
+  for (const Step& step: steps) {
+    const std::string key = step.name + "#" +
+      boost::lexical_cast<std::string>(occurrences[step.name]++);
+    boost::shared_ptr<Effect>& effect = instances_[key];
+    if (!effect) {
+      PropertyNames names;
+      if (step.name == icc_step_name) {
+        effect.reset(new IccEffect(sRGB_));
+      } else {
+        effect = EffectFactory::get_instance() -> make_effect(step.name);
+        const auto i = effects_.map.find(step.name);
+        if (i != effects_.map.end()) {
+          for (const auto& prop: i -> second)
+            names.insert(prop.first);
+        }
+      }
+      effect -> prepare(geometry, names);
+    }
+    effects.push_back(effect.get());
+  }
+
+  return effects;
+}
+
+// apply step, writing the output into the canvas prepared by the next step;
+// returns false if this isn't possible
+template <class T>
+bool render_into_canvas(GenericImage<T>& image, const Step& step,
+    const Step& next, Effect& effect, Effect& next_effect, int verb)
+{
+  if (!effect.can_render())
+    return false;
+
+  const std::pair<size_t, size_t> size = EffectFactory::get_instance() ->
+    get_output_size(step.name, step.properties, image.getWidth(),
+      image.getHeight());
+  GenericImage<T> canvas, interior;
+  if (!next_effect.make_canvas(image, size.first, size.second, canvas,
+        interior))
+    return false;
+
+  // (the name is only needed when the stages are traced or measured)
+  const std::string name = (Tracer::getInstance().isEnabled() ||
+    PerfCounters::getInstance().isEnabled())?
+    step.name + " into " + next.name:std::string();
+  TraceSpan span("effect", name.c_str());
+  PerfStage perf(name.c_str(), &span);
+  if (!interior.isEmpty(GenericImage<T>::SEL_IMAGE) &&
+      !effect.render(image, interior, verb))
+    return false;
+  if (verb >= 2) {
+    std::cout << "Rendered " << step.name << " directly into the " << next.name
+              << " canvas" << std::endl;
+  }
+
+  image = canvas;
+  return true;
+}
+
+// convert the image to the pixel layout used by the step
+template <class T>
+void set_layout(GenericImage<T>& image, const Step& step)
+{
+  // the color transform handles any layout
+  if (step.name == icc_step_name)
+    return;
+
+  const ImageLayout layout = EffectFactory::get_instance() ->
+    get_layout(step.name);
+  if (layout != LAYOUT_ANY && layout != image.getLayout())
+    image.setLayout(layout);
+}
+
+// apply the steps to the image, in order, using the given effects
+template <class T>
+void apply_steps(GenericImage<T>& image, const Steps& steps,
+    const std::vector<Effect*>& effects, int verb)
+{
+  // the properties are known ahead of time, so the effects can all be
+  // updated first, and the canvases made with the right properties
+  for (size_t k = 0; k < steps.size(); ++k) {
+    if (!effects[k] -> update(steps[k].properties) && verb >= 2) {
+      std::cout << "Properties of " << steps[k].name << " unchanged, reusing "
+                << "its state" << std::endl;
+    }
+  }
+
+  for (size_t k = 0; k < steps.size(); ++k) {
+    set_layout(image, steps[k]);
+
+    // if the next step can prepare its output canvas ahead of time, this
+    // step can write straight into it
+    if (k + 1 < steps.size() &&
+        render_into_canvas(image, steps[k], steps[k + 1], *effects[k],
+          *effects[k + 1], verb)) {
+      ++k;
+      continue;
+    }
+
+    TraceSpan span("effect", steps[k].name.c_str());
+    PerfStage perf(steps[k].name.c_str(), &span);
+    effects[k] -> apply(image, verb);
+  }
+}
+
+// read the contents of a file
+std::string read_file(const std::string& name)
 {
-  --i;
-  return i;
+  std::ifstream f(name.c_str(), std::ios::binary);
+  if (!f)
+    throw std::runtime_error("Could not read " + name + ".");
+  std::ostringstream contents;
+  contents << f.rdbuf();
+  return contents.str();
+}
+
+// 64-bit FNV-1a hash of a string
+uint64_t hash_string(const std::string& s)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < s.size(); ++i) {
+    hash ^= (unsigned char)s[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// hash of the values of all the properties in a frame, which is the same
+// for frames with the same values in the sense of Timeline::same_values
+uint64_t hash_values(const Timeline& timeline, size_t frame)
+{
+  const double* values = timeline.get_values(frame);
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t id = 0; id < timeline.get_property_count(); ++id) {
+    // all NaNs are the same, and so are the two zeros
+    double value = values[id];
+    if (std::isnan(value))
+      value = std::numeric_limits<double>::quiet_NaN();
+    else if (value == 0)
+      value = 0;
+    const unsigned char* bytes = (const unsigned char*)&value;
+    for (size_t k = 0; k < sizeof(value); ++k) {
+      hash ^= bytes[k];
+      hash *= 1099511628211ULL;
+    }
+  }
+  return hash;
+}
+
+// finds the frames that are the same as an earlier one: their input files
+// have the same contents, and their properties are the same
+class FrameMatcher {
+ public:
+  explicit FrameMatcher(const Timeline& timeline) : timeline_(timeline) {}
+
+  // find an earlier frame that is the same as frame i, whose input is file;
+  // returns -1 if there is none, and then remembers frame i
+  int find(size_t i, const std::string& file);
+
+ private:
+  // a frame with a different input or properties from all earlier ones
+  typedef std::pair<size_t, std::string> Frame;
+
+  // the frames with the same hash of their property values, and the same
+  // size of input file
+  struct Group {
+    // frames whose file hasn't been read yet
+    std::vector<Frame>                            unread;
+    // the others, by the hash of the contents of their file
+    std::map<uint64_t, std::vector<Frame> >       by_contents;
+  };
+
+  const Timeline&   timeline_;
+  // a file is only read when an earlier frame has the same values and the
+  // same file size, which is rare unless the values stop changing, and then
+  // usually means that the frame can be reused; each file is read at most
+  // once to find its hash, so a lookup takes a constant number of reads
+  std::map<std::pair<uint64_t, uintmax_t>, Group> groups_;
+};
+
+int FrameMatcher::find(size_t i, const std::string& file)
+{
+  Group& group = groups_[std::make_pair(hash_values(timeline_, i),
+    fs::file_size(file))];
+  if (group.unread.empty() && group.by_contents.empty()) {
+    group.unread.push_back(Frame(i, file));
+    return -1;
+  }
+
+  for (const Frame& frame: group.unread) {
+    group.by_contents[hash_string(read_file(frame.second))].push_back(
+      frame);
+  }
+  group.unread.clear();
+
+  const std::string contents = read_file(file);
+  std::vector<Frame>& candidates = group.by_contents[hash_string(contents)];
+  for (const Frame& candidate: candidates) {
+    // (the files are compared in full, in case of a hash collision)
+    if (timeline_.same_values(i, candidate.first) &&
+        (candidate.second == file || read_file(candidate.second) == contents))
+      return candidate.first;
+  }
+  candidates.push_back(Frame(i, file));
+  return -1;
+}
+
+// make target a hard link to source, or a copy if links are not possible
+void link_or_copy(const std::string& source, const std::string& target)
+{
+  boost::system::error_code error;
+  fs::remove(target, error);
+  fs::create_hard_link(source, target, error);
+  if (error)
+    fs::copy_file(source, target);
+}
+
+// make a 16-bit copy of an 8-bit image, scaling 255 to 65535
+Image16 widen(const Image8& image8)
+{
+  const size_t width = image8.getWidth();
+  const size_t ncomps = image8.getChannelCount();
+  Image16 image16;
+  image16.reshape(width, image8.getHeight());
+  image16.setChannelCount(ncomps);
+  image16.allocate();
+  image16.copyMetadataFrom(image8);
+  if (!image8.getChannelTypes().empty())
+    image16.setChannelTypes(image8.getChannelTypes());
+
+  ThreadPool::getInstance().parallelFor(image8.getHeight(),
+    [&](size_t y1, size_t y2) {
+      std::vector<Image8::value_type> row(width*ncomps);
+      for (size_t y = y1; y < y2; ++y) {
+        const Image8::ConstRowIterator src = image8.row(y);
+        copyPixelRow(src.getData(), src.getPixelStride(),
+          src.getChannelStride(), &row[0], ncomps, 1, width, ncomps);
+        Image16::value_type* dest = image16(0, y);
+        for (size_t i = 0; i < width*ncomps; ++i)
+          dest[i] = row[i]*257;
+      }
+    }, 16);
+
+  return image16;
+}
+
+// round a 16-bit image to 8 bits; this is the only place where the 16-bit
+// path loses precision, so it's also where it is dithered, if asked to
+Image8 narrow(const Image16& image16, bool dither)
+{
+  const size_t width = image16.getWidth();
+  const size_t ncomps = image16.getChannelCount();
+  Image8 image8;
+  image8.reshape(width, image16.getHeight());
+  image8.setChannelCount(ncomps);
+  image8.allocate();
+  image8.copyMetadataFrom(image16);
+  if (!image16.getChannelTypes().empty())
+    image8.setChannelTypes(image16.getChannelTypes());
+
+  ThreadPool::getInstance().parallelFor(image16.getHeight(),
+    [&](size_t y1, size_t y2) {
+      std::vector<Image16::value_type> row(width*ncomps);
+      std::vector<float> scaled(width*ncomps);
+      for (size_t y = y1; y < y2; ++y) {
+        const Image16::ConstRowIterator src = image16.row(y);
+        copyPixelRow(src.getData(), src.getPixelStride(),
+          src.getChannelStride(), &row[0], ncomps, 1, width, ncomps);
+        for (size_t i = 0; i < width*ncomps; ++i)
+          scaled[i] = row[i]*(1.0f/257);
+        if (dither)
+          quantizeRowDithered(&scaled[0], width, ncomps, image8(0, y), 0, y);
+        else
+          quantizeRow(&scaled[0], width*ncomps, image8(0, y));
+      }
+    }, 16);
+
+  return image8;
+}
+
+// whether any of the steps asks for dithering, which is an option of the
+// exposure effect
+bool wants_dither(const Steps& steps)
+{
+  for (const Step& step: steps) {
+    const auto it = step.properties.find("dither");
+    if (step.name == "exposure" && it != step.properties.end() &&
+        it -> second >= 0.5)
+      return true;
+  }
+  return false;
 }
 
 } // anonymous namespace
@@ -99,6 +462,18 @@ void Processor::parse_effects(const std::string& effects)
       token += c;
     }
   }
+
+  update_timeline_();
+}
+
+bool Processor::can_use_native_ycc_() const
+{
+  for (const std::string& effect_name: effects_.order) {
+    if (effect_name != "cropresize")
+      return false;
+  }
+
+  return true;
 }
 
 void Processor::run()
@@ -123,52 +498,73 @@ void Processor::run()
   boost::format formatter("%|0" + boost::lexical_cast<std::string>(xlen) +
     "|");
 
-  const size_t nframes = files_.size();
-  for (size_t i = 0; i < nframes; ++i) {
-    if (verbosity_ > 0) {
-      std::cout << "Working on frame " << i << " (" << files_[i] << ")..."
-                << std::endl;
+  if (verbosity_ > 0) {
+    const CpuDispatch& cpu = CpuDispatch::getInstance();
+    std::cout << "Using " << CpuDispatch::getLevelName(cpu.getLevel())
+              << " pixel kernels";
+    if (!cpu.getOverride().empty()) {
+      std::cout << " (LAPSE_CPU=" << cpu.getOverride() << ", detected "
+                << CpuDispatch::getLevelName(cpu.getDetectedLevel()) << ")";
     }
+    std::cout << "." << std::endl;
+    if (depth_ == 16)
+      std::cout << "Processing frames with 16 bits per channel." << std::endl;
+  }
 
-    // load image and transform to sRGB
-    Image8 image8 = io.load(files_[i]);
+  Planner::Stats total_stats;
 
-    if (image8.hasMetadatum("icc")) {
-      const Blob& icc = image8.getMetadatum("icc").blob;
+  const bool native_ycc = native_ycc_ && can_use_native_ycc_();
+  if (native_ycc_ && !native_ycc && verbosity_ > 0) {
+    std::cout << "Not all effects are crops and resizes, converting frames to "
+              << "RGB." << std::endl;
+  }
 
-      // get the profile of the image
-      ColorProfile profile = ColorProfileFactory::fromMemory(icc.begin(),
-        icc.end());
-      ColorTransform transform = ColorTransformFactory::fromProfiles(
-          profile, image8, sRGB, image8, INTENT_PERCEPTUAL);
+  // the effects keep what they can from one frame to the next
+  EffectInstances instances(effects_, sRGB);
+  // and whole frames that are the same as earlier ones are not redone
+  FrameMatcher matcher(timeline_);
+  std::vector<std::string> out_names;
+  size_t nreused = 0;
 
-      // apply the transform to the image
-      transform.apply(image8.getData(), image8.getData(),
-        image8.getWidth()*image8.getHeight());
-    }
+  if (!trace_.empty())
+    Tracer::getInstance().setEnabled(true);
+  // this has to be done before the worker threads are started, so that they
+  // are counted too
+  PerfCounters& perf_counters = PerfCounters::getInstance();
+  if (perf_counters_ && !perf_counters.setEnabled(true)) {
+    std::cerr << "Performance counters are not available ("
+              << perf_counters.getError() << "), not measuring them."
+              << std::endl;
+  } else if (perf_counters_ && !perf_counters.getError().empty() &&
+      verbosity_ > 0) {
+    std::cout << "Some performance counters are not available ("
+              << perf_counters.getError() << ")." << std::endl;
+  }
 
-    // find all the effects for this frame, and apply them
-    for (std::string effect_name: effects_.order) {
-      auto effect = effects_.map[effect_name];
-      PropertyMap properties;
-      for (auto prop: effect) {
-        const auto k2 = prop.second.upper_bound(i);
-        if (k2 != prop.second.begin()) {
-          // by definition of 'upper_bound', k1's frame is <= i
-          const auto k1 = prev_it(k2);
-          if (k2 == prop.second.end()) {
-            // we have only one keyframe, so no interpolation
-            properties[prop.first] = k1 -> second;
-          } else {
-            // interpolate
-            const double a = double(i - k1->first) / (k2->first - k1->first);
-            properties[prop.first] = (1-a)*k1->second + a*k2->second;
-          }
-        } // otherwise we have only one keyframe which we haven't reached yet
-      }
+  // the time for the whole run, which makes it easy to compare settings
+  // (such as the bit depth) on the same job
+  Timer timer;
+  const size_t nframes = files_.size();
 
-      EffectFactory::get_instance() ->
-        get_effect(effect_name)(image8, properties, verbosity_);
+  // on a terminal, update the progress often and in place; in a log, write a
+  // line every so often
+  const bool progress_tty = isatty(fileno(stderr));
+  boost::shared_ptr<ProgressReporter> progress;
+  if (progress_) {
+    progress.reset(new ProgressReporter(nframes, std::cerr, progress_tty,
+      progress_tty?0.5:10.0));
+  }
+  // a line updated in place gets garbled by anything else written to the
+  // same terminal, so the messages for each frame are left out then
+  const bool frame_messages = !(progress && progress_tty &&
+    isatty(fileno(stdout)));
+  for (size_t i = 0; i < nframes; ++i) {
+    const std::string frame_name = Tracer::getInstance().isEnabled()?
+      "frame " + boost::lexical_cast<std::string>(i):std::string();
+    TraceSpan frame_span("frame", frame_name.c_str());
+    if (verbosity_ > 0 && frame_messages) {
+      std::cout << "Working on frame " << i << " (" << files_[i] << ")..."
+                << std::endl;
     }
 
     // figure out the name of the output file
@@ -177,10 +573,143 @@ void Processor::run()
     const std::string num_str = out_stem.substr(0, xstart)+num_str_stream.str();
     std::string out_name = (out_parent / num_str).replace_extension(out_ext).
       native();
+    out_names.push_back(out_name);
+
+    if (reuse_frames_) {
+      const int same = matcher.find(i, files_[i]);
+      if (same >= 0) {
+        if (verbosity_ > 0 && frame_messages) {
+          std::cout << "Same as frame " << same << ", reusing "
+                    << out_names[same] << " for " << out_name << "..."
+                    << std::endl;
+        }
+        TraceSpan span("write", "reuse");
+        if (progress) progress -> start_stage(ProgressReporter::WRITE);
+        link_or_copy(out_names[same], out_name);
+        ++nreused;
+        if (progress) progress -> skip_frame();
+        continue;
+      }
+    }
+
+    if (native_ycc) {
+      TraceSpan load_span("load", "load");
+      PerfStage load_perf("load", &load_span);
+      JpegIO::RawImage raw = io.loadRaw(files_[i]);
+      load_perf.end();
+      load_span.end();
+      if (progress) progress -> start_stage(ProgressReporter::EFFECTS);
+      for (const Step& step: timeline_.get_steps(i)) {
+        TraceSpan span("effect", step.name.c_str());
+        PerfStage perf(step.name.c_str(), &span);
+        CropResizeEffect::apply_planar(raw, step.properties, verbosity_);
+      }
+
+      if (frame_messages)
+        std::cout << "Writing to " << out_name << "..." << std::endl;
+      TraceSpan write_span("write", "write");
+      PerfStage write_perf("write", &write_span);
+      if (progress) progress -> start_stage(ProgressReporter::WRITE);
+      io.writeRaw(out_name, raw);
+      if (progress) progress -> end_frame(raw.getWidth()*raw.getHeight());
+      continue;
+    }
+
+    // load image
+    TraceSpan load_span("load", "load");
+    PerfStage load_perf("load", &load_span);
+    Image8 image8 = io.load(files_[i]);
+    load_perf.end();
+    load_span.end();
+    if (progress) progress -> start_stage(ProgressReporter::EFFECTS);
+
+    // find all the steps for this frame: first transform to sRGB, then the
+    // effects in order
+    Steps steps;
+    if (image8.hasMetadatum("icc"))
+      steps.push_back(Step{icc_step_name, PropertyMap()});
+    const Steps effect_steps = timeline_.get_steps(i);
+    steps.insert(steps.end(), effect_steps.begin(), effect_steps.end());
+
+    if (reorder_) {
+      Planner::Stats stats;
+      steps = planner_.plan(steps, image8.getWidth(), image8.getHeight(),
+        &stats);
+      total_stats += stats;
+      if (verbosity_ >= 2) {
+        std::cout << "Order:";
+        for (const Step& step: steps)
+          std::cout << " " << step.name;
+        std::cout << " (pointwise work " << stats.pixels_before << " -> "
+                  << stats.pixels_after << " pixels)" << std::endl;
+      }
+    }
+
+    // apply the steps
+    const FrameGeometry geometry{image8.getWidth(), image8.getHeight(),
+      image8.getChannelCount()};
+    const std::vector<Effect*> effects = instances.get(steps, geometry);
+    if (depth_ == 16) {
+      TraceSpan widen_span("convert", "widen");
+      PerfStage widen_perf("widen", &widen_span);
+      Image16 image16 = widen(image8);
+      widen_perf.end();
+      widen_span.end();
+      apply_steps(image16, steps, effects, verbosity_);
+      TraceSpan narrow_span("convert", "narrow");
+      PerfStage narrow_perf("narrow", &narrow_span);
+      image8 = narrow(image16, wants_dither(steps));
+    } else {
+      apply_steps(image8, steps, effects, verbosity_);
+    }
 
-    std::cout << "Writing to " << out_name << "..." << std::endl;
+    if (frame_messages)
+      std::cout << "Writing to " << out_name << "..." << std::endl;
 
     // XXX how do we decide on quality? Can we read it from original file?
+    TraceSpan write_span("write", "encode and write");
+    PerfStage write_perf("write", &write_span);
+    if (progress) progress -> start_stage(ProgressReporter::WRITE);
     io.write(out_name, image8);
+    if (progress)
+      progress -> end_frame(image8.getWidth()*image8.getHeight());
+  }
+  if (progress) progress -> finish();
+
+  if (perf_counters.isEnabled()) {
+    std::cout << "Performance counters for each stage (stages that run "
+              << "inside others are also counted in them):" << std::endl;
+    perf_counters.writeSummary(std::cout);
+    perf_counters.setEnabled(false);
+  }
+
+  if (!trace_.empty()) {
+    std::ofstream f(trace_.c_str());
+    Tracer::getInstance().write(f);
+    if (!f)
+      throw std::runtime_error("Could not write the trace to " + trace_ + ".");
+    if (verbosity_ > 0) {
+      std::cout << "Wrote " << Tracer::getInstance().getSpanCount()
+                << " spans to " << trace_ << "." << std::endl;
+    }
+  }
+
+  if (verbosity_ > 0 && nframes > 0) {
+    const double elapsed = timer.getElapsed();
+    std::cout << "Processed " << nframes << " frames in " << elapsed
+              << " s (" << 1000*elapsed/nframes << " ms per frame)."
+              << std::endl;
+  }
+
+  if (verbosity_ > 0 && nreused > 0) {
+    std::cout << "Reused the output of earlier frames for " << nreused
+              << " of " << nframes << " frames." << std::endl;
+  }
+
+  if (reorder_ && verbosity_ > 0 && total_stats.pixels_before > 0) {
+    const double saved = total_stats.pixels_before - total_stats.pixels_after;
+    std::cout << "Reordering saved " << saved << " of "
+              << total_stats.pixels_before << " pixels in pointwise steps ("
+              << 100.0*saved/total_stats.pixels_before << "%)." << std::endl;
   }
 }
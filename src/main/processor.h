@@ -7,38 +7,37 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <stdexcept>
 
 #include <boost/lexical_cast.hpp>
 
 #include "image/image.h"
+#include "planner.h"
+#include "timeline.h"
 
 /// A convenient definition.
 typedef std::vector<std::string> strings;
 
-/// A set of keyframes is a map from keyframe index to value.
-typedef std::map<int, double> Keyframes;
-/// A set of properties is a map from property names to @a Keyframes.
-typedef std::map<std::string, Keyframes> Properties;
-// Each transformation is mapped to its own @a Properties.
-typedef std::map<std::string, Properties> EffectsMap;
-/// Keep both maps to keyframes and the order in which transformations appeared.
-struct Effects {
-  /// The mapping from transformation names, to properties, to keyframes.
-  EffectsMap                map;
-  /// The order in which the transformations first appeared.
-  std::vector<std::string>  order;
-};
-
 /// Class handling the processing of images.
 class Processor {
  public:
-  Processor() : verbosity_(1) {}
+  Processor() : verbosity_(1), reorder_(false), native_ycc_(false),
+    depth_(8), reuse_frames_(true), progress_(false),
+    perf_counters_(false) {}
 
   /// Add files to the list.
-  void add_files(const strings& more)
-    { files_.insert(files_.end(), more.begin(), more.end()); }
-  /// Parse an effects string, and store them.
+  void add_files(const strings& more) {
+    files_.insert(files_.end(), more.begin(), more.end());
+    update_timeline_();
+  }
+  /** @brief Parse an effects string, and store them.
+   *
+   *  The keyframes are compiled into a @a Timeline for all the files added
+   *  so far (and for those added later).
+   */
   void parse_effects(const std::string& effects);
+  /// Get the properties of the effects for every frame.
+  const Timeline& get_timeline() const { return timeline_; }
   /// Run the processor.
   void run();
 
@@ -52,15 +51,131 @@ class Processor {
   /// Get output file name template.
   std::string get_output() const { return output_template_; }
 
+  /** @brief Set whether to reorder the effects to do less work.
+   *
+   *  When this is on, crops are done before the color conversion and the
+   *  pointwise effects, whenever this gives exactly the same result.
+   *
+   *  @see Planner.
+   */
+  void set_reorder(bool b) { reorder_ = b; }
+  /// Get whether effects are reordered.
+  bool get_reorder() const { return reorder_; }
+  /** @brief Set whether downscaling is also moved before the pointwise
+   *         effects when reordering.
+   *
+   *  This is faster, but the results are only approximately the same.
+   */
+  void set_reorder_downscale(bool b) { planner_.set_hoist_downscale(b); }
+  /// Get whether downscaling is moved before the pointwise effects.
+  bool get_reorder_downscale() const
+    { return planner_.get_hoist_downscale(); }
+
+  /** @brief Set whether crop/resize-only jobs work directly on the JPEG
+   *         components.
+   *
+   *  When this is on and all the effects are crops and resizes, the frames
+   *  are never converted to RGB: the components are loaded as they are stored
+   *  in the file (usually YCbCr, with subsampled chroma), each is cropped and
+   *  resized at its own resolution, and they are written back without any
+   *  color conversion. The embedded ICC profile is kept, since the pixel
+   *  values are not changed.
+   */
+  void set_native_ycc(bool b) { native_ycc_ = b; }
+  /// Get whether crop/resize-only jobs work directly on the JPEG components.
+  bool get_native_ycc() const { return native_ycc_; }
+
+  /** @brief Set the number of bits per channel used while processing.
+   *
+   *  This is either 8 or 16. With 16 bits, frames are widened right after
+   *  they are loaded, all the effects and color transforms work on 16-bit
+   *  values, and the result is only rounded to 8 bits when it is written.
+   *  This avoids the accumulated rounding and banding of heavy grades, at
+   *  the cost of twice the memory traffic.
+   */
+  void set_depth(int bits) {
+    if (bits != 8 && bits != 16)
+      throw std::runtime_error("[Processor::set_depth] Only 8 and 16 bits "
+        "per channel are supported.");
+    depth_ = bits;
+  }
+  /// Get the number of bits per channel used while processing.
+  int get_depth() const { return depth_; }
+
+  /** @brief Set whether to reuse the output of identical frames.
+   *
+   *  When this is on, a frame whose input file has the same contents as that
+   *  of an earlier frame, and whose effects have the same properties, is not
+   *  processed again: its output is a hard link to the earlier output, or a
+   *  copy if links are not possible. This makes holds made of repeated
+   *  frames nearly free.
+   */
+  void set_reuse_frames(bool b) { reuse_frames_ = b; }
+  /// Get whether the output of identical frames is reused.
+  bool get_reuse_frames() const { return reuse_frames_; }
+
+  /** @brief Set the file to write a trace of the run to.
+   *
+   *  The trace has the time spent in each stage of every frame (loading,
+   *  each effect, each resize pass, writing), on each thread, in the Chrome
+   *  trace-event format (see @a Tracer). Leave this empty for no trace.
+   */
+  void set_trace(const std::string& s) { trace_ = s; }
+  /// Get the file the trace is written to.
+  std::string get_trace() const { return trace_; }
+
+  /** @brief Set whether to report the rate of processing and the time left.
+   *
+   *  The reports go to standard error; see @a ProgressReporter.
+   */
+  void set_progress(bool b) { progress_ = b; }
+  /// Get whether progress is reported.
+  bool get_progress() const { return progress_; }
+
+  /** @brief Set whether to measure hardware performance counters for each
+   *         stage.
+   *
+   *  The totals for each stage are printed at the end of the run, and the
+   *  counts for each run of a stage go into the trace, if there is one. This
+   *  only works on Linux, when the counters are available; see
+   *  @a PerfCounters.
+   */
+  void set_perf_counters(bool b) { perf_counters_ = b; }
+  /// Get whether hardware performance counters are measured.
+  bool get_perf_counters() const { return perf_counters_; }
+
  private:
   /// The list of files we're working with.
   strings           files_;
   /// The structure holding the effects to be applied.
   Effects           effects_;
+  /// The properties of the effects, interpolated for every frame.
+  Timeline          timeline_;
   /// Verbosity level.
   int               verbosity_;
   /// Template for output file names.
   std::string       output_template_;
+  /// Whether to reorder the effects.
+  bool              reorder_;
+  /// The object doing the reordering.
+  Planner           planner_;
+  /// Whether to work directly on JPEG components when possible.
+  bool              native_ycc_;
+  /// Bits per channel used while processing.
+  int               depth_;
+  /// Whether to reuse the output of identical frames.
+  bool              reuse_frames_;
+  /// File to write a trace to, if any.
+  std::string       trace_;
+  /// Whether to report progress.
+  bool              progress_;
+  /// Whether to measure performance counters.
+  bool              perf_counters_;
+
+  /// Interpolate the properties of the effects for all the files.
+  void update_timeline_() { timeline_ = Timeline(effects_, files_.size()); }
+  /// Check whether all the effects can be applied to JPEG components.
+  bool can_use_native_ycc_() const;
 };
 
 #endif
@@ -0,0 +1,148 @@
+#include "progress.h"
+
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+namespace {
+
+// format a duration in seconds as h:mm:ss
+std::string format_duration(double seconds)
+{
+  const long s = (long)(seconds + 0.5);
+  std::ostringstream str;
+  str << s/3600 << ":" << std::setfill('0') << std::setw(2) << (s/60)%60
+      << ":" << std::setw(2) << s%60;
+  return str.str();
+}
+
+} // anonymous namespace
+
+ProgressReporter::ProgressReporter(size_t nframes, std::ostream& out,
+    bool in_place, double interval)
+  : nframes_(nframes), out_(out), in_place_(in_place),
+    interval_(interval*1000000), counter_(size_t(20)), nskipped_(0),
+    last_report_(0), stage_(LOAD), stage_start_(0), line_length_(0)
+{
+  for (size_t i = 0; i < NSTAGES; ++i)
+    stage_time_[i] = 0;
+}
+
+const char* ProgressReporter::get_stage_name(Stage stage)
+{
+  switch (stage) {
+    case LOAD: return "load";
+    case EFFECTS: return "effects";
+    case WRITE: return "write";
+    default: return "unknown";
+  }
+}
+
+void ProgressReporter::start_stage(Stage stage)
+{
+  const long now = timer_.getElapsedUsec();
+  stage_time_[stage_] += now - stage_start_;
+  stage_ = stage;
+  stage_start_ = now;
+}
+
+void ProgressReporter::end_frame(size_t pixels)
+{
+  start_stage(LOAD);
+  counter_.addFrame();
+  // keep the pixel counts for the same frames as the counter
+  pixels_.push_back(pixels);
+  while (pixels_.size() > counter_.getFrames().size())
+    pixels_.pop_front();
+  maybe_report_();
+}
+
+void ProgressReporter::skip_frame()
+{
+  start_stage(LOAD);
+  ++nskipped_;
+  maybe_report_();
+}
+
+void ProgressReporter::finish()
+{
+  if (in_place_ && line_length_ > 0) {
+    out_ << std::endl;
+    line_length_ = 0;
+  }
+}
+
+void ProgressReporter::maybe_report_()
+{
+  if (stage_start_ - last_report_ >= interval_ ||
+      counter_.getTotalCount() + nskipped_ == nframes_)
+    report_();
+}
+
+void ProgressReporter::report_()
+{
+  const size_t processed = counter_.getTotalCount();
+  const size_t done = processed + nskipped_;
+  const double elapsed = stage_start_/1000000.0;
+
+  // the rates over the window; until there are two frames in it, use the
+  // average over the whole run
+  double fps = counter_.getFrameRate();
+  double mpix = 0;
+  for (size_t i = 1; i < pixels_.size(); ++i)
+    mpix += pixels_[i];
+  if (fps > 0) {
+    mpix *= fps/(pixels_.size() - 1)/1e6;
+  } else {
+    fps = (elapsed > 0)?processed/elapsed:0;
+    mpix = (elapsed > 0 && !pixels_.empty())?pixels_.back()/elapsed/1e6:0;
+  }
+  const double eta = (fps > 0)?(nframes_ - done)/fps:0;
+
+  long total = 0;
+  Stage busiest = LOAD;
+  for (size_t i = 0; i < NSTAGES; ++i) {
+    total += stage_time_[i];
+    if (stage_time_[i] > stage_time_[busiest])
+      busiest = Stage(i);
+  }
+
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(2);
+  if (in_place_) {
+    line << "Frame " << done << "/" << nframes_;
+    if (nskipped_ > 0)
+      line << " (" << nskipped_ << " reused)";
+    line << ", " << fps
+         << " frames/s, " << std::setprecision(1) << mpix << " MPix/s, ETA "
+         << format_duration(eta) << " (";
+    for (size_t i = 0; i < NSTAGES; ++i) {
+      line << (i > 0?", ":"") << get_stage_name(Stage(i)) << " "
+           << (total > 0?100*stage_time_[i]/total:0) << "%";
+    }
+    line << "; busiest: " << get_stage_name(busiest) << ")";
+    // pad with spaces to cover the rest of the previous line
+    const size_t length = line.str().size();
+    if (length < line_length_)
+      line << std::string(line_length_ - length, ' ');
+    line_length_ = length;
+    out_ << "\r" << line.str() << std::flush;
+  } else {
+    line << "progress frame=" << done << " total=" << nframes_
+         << " reused=" << nskipped_
+         << " elapsed_s=" << std::setprecision(1) << elapsed
+         << " fps=" << std::setprecision(3) << fps
+         << " mpix_s=" << std::setprecision(2) << mpix
+         << " eta_s=" << std::setprecision(0) << eta;
+    for (size_t i = 0; i < NSTAGES; ++i) {
+      line << " " << get_stage_name(Stage(i)) << "_pct="
+           << (total > 0?100*stage_time_[i]/total:0);
+    }
+    line << " busiest=" << get_stage_name(busiest);
+    out_ << line.str() << std::endl;
+  }
+
+  last_report_ = stage_start_;
+  for (size_t i = 0; i < NSTAGES; ++i)
+    stage_time_[i] = 0;
+}
@@ -0,0 +1,102 @@
+/** @file progress.h
+ *  @brief Reporting of the rate of processing and the time left.
+ */
+#ifndef LAPSE_PROGRESS_H_
+#define LAPSE_PROGRESS_H_
+
+#include <deque>
+#include <iosfwd>
+#include <string>
+
+#include "misc/timer.h"
+
+/** @brief Reports how fast frames are being processed, and when the run will
+ *         be done.
+ *
+ *  The rates (frames per second and megapixels per second) are averaged over
+ *  a sliding window of the last 20 processed frames, using a
+ *  @a FrequencyCounter, and the time left is estimated from them. The time
+ *  spent in each stage of the processing since the last report is also
+ *  given, which shows the stage that limits the rate.
+ *
+ *  On a terminal the report is a single line that is updated in place;
+ *  otherwise a line of @a key=value pairs is written at regular intervals,
+ *  which is easy to parse from a log.
+ *
+ *  The per-frame cost is a few reads of the clock, and a report is written
+ *  at most once per interval.
+ */
+class ProgressReporter {
+ public:
+  /// The stages of the processing of a frame.
+  enum Stage { LOAD = 0, EFFECTS, WRITE, NSTAGES };
+
+  /** @brief Constructor.
+   *
+   *  @param nframes The total number of frames in the run.
+   *  @param out Where to write the reports.
+   *  @param in_place Whether to update a single line in place, for a
+   *                  terminal.
+   *  @param interval The minimum time between reports, in seconds.
+   */
+  ProgressReporter(size_t nframes, std::ostream& out, bool in_place,
+    double interval);
+
+  /// Get the name of a stage.
+  static const char* get_stage_name(Stage stage);
+
+  /** @brief Mark the start of a stage.
+   *
+   *  The time since the previous call goes to the previous stage.
+   */
+  void start_stage(Stage stage);
+
+  /** @brief Mark the end of a frame, with the number of pixels it had.
+   *
+   *  This writes a report if the interval has passed since the last one, or
+   *  if this was the last frame.
+   */
+  void end_frame(size_t pixels);
+  /** @brief Mark the end of a frame that was not processed, because the
+   *         output of an earlier frame could be used for it.
+   *
+   *  The frame counts as done, but since it takes almost no time, it is left
+   *  out of the rates, which would otherwise be too high.
+   */
+  void skip_frame();
+
+  /// Finish the report, if it was updated in place.
+  void finish();
+
+ private:
+  // write a report if it's time for one
+  void maybe_report_();
+  // write a report and start a new interval
+  void report_();
+
+  size_t              nframes_;
+  std::ostream&       out_;
+  bool                in_place_;
+  long                interval_;
+
+  /// The times at which frames were done, over the sliding window.
+  FrequencyCounter    counter_;
+  /// The number of pixels in the frames that are in the window.
+  std::deque<size_t>  pixels_;
+  /// The number of frames that were skipped.
+  size_t              nskipped_;
+
+  /// The time for the whole run.
+  Timer               timer_;
+  /// The time of the last report.
+  long                last_report_;
+  /// The time in each stage since the last report, in microseconds.
+  long                stage_time_[NSTAGES];
+  /// The current stage, and when it started.
+  Stage               stage_;
+  long                stage_start_;
+  /// The length of the last line written in place.
+  size_t              line_length_;
+};
+
+#endif
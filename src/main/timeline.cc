@@ -0,0 +1,129 @@
+#include "timeline.h"
+
+#include <cmath>
+#include <limits>
+#include <ostream>
+
+Timeline::Timeline(const Effects& effects, size_t nframes)
+  : nframes_(nframes)
+{
+  for (const std::string& effect_name: effects.order) {
+    const EffectsMap::const_iterator effect = effects.map.find(effect_name);
+    EffectEntry entry{effect_name, names_.size(), 0};
+    if (effect != effects.map.end()) {
+      for (const auto& prop: effect -> second)
+        names_.push_back(prop.first);
+      entry.count = effect -> second.size();
+    }
+    effects_.push_back(entry);
+  }
+
+  const size_t nprops = names_.size();
+  values_.assign(nframes*nprops, std::numeric_limits<double>::quiet_NaN());
+  for (const EffectEntry& entry: effects_) {
+    if (entry.count == 0)
+      continue;
+    const Properties& props = effects.map.find(entry.name) -> second;
+    size_t id = entry.first;
+    for (auto prop = props.begin(); prop != props.end(); ++prop, ++id) {
+      const Keyframes& keyframes = prop -> second;
+      if (keyframes.empty())
+        continue;
+      // walk through the frames and the keyframes together; k2 is the first
+      // keyframe after the current frame
+      Keyframes::const_iterator k2 = keyframes.begin();
+      for (size_t i = 0; i < nframes; ++i) {
+        while (k2 != keyframes.end() && k2 -> first <= (int)i)
+          ++k2;
+        // no value before the first keyframe
+        if (k2 == keyframes.begin())
+          continue;
+        Keyframes::const_iterator k1 = k2;
+        --k1;
+        double& value = values_[i*nprops + id];
+        if (k2 == keyframes.end()) {
+          // past the last keyframe, so no interpolation
+          value = k1 -> second;
+        } else {
+          const double a = double(i - k1 -> first)/(k2 -> first - k1 -> first);
+          value = (1 - a)*k1 -> second + a*k2 -> second;
+        }
+      }
+    }
+  }
+}
+
+int Timeline::find_property(const std::string& effect,
+    const std::string& name) const
+{
+  for (const EffectEntry& entry: effects_) {
+    if (entry.name != effect)
+      continue;
+    for (size_t id = entry.first; id < entry.first + entry.count; ++id) {
+      if (names_[id] == name)
+        return id;
+    }
+  }
+  return -1;
+}
+
+bool Timeline::same_values(size_t frame1, size_t frame2) const
+{
+  const double* values1 = get_values(frame1);
+  const double* values2 = get_values(frame2);
+  for (size_t id = 0; id < names_.size(); ++id) {
+    // (properties with no value are NaN in both)
+    if (values1[id] != values2[id] &&
+        !(std::isnan(values1[id]) && std::isnan(values2[id])))
+      return false;
+  }
+  return true;
+}
+
+PropertyMap Timeline::get_properties(size_t frame, size_t effect) const
+{
+  const EffectEntry& entry = effects_[effect];
+  const double* values = get_values(frame);
+  PropertyMap properties;
+  for (size_t id = entry.first; id < entry.first + entry.count; ++id) {
+    // the names are sorted, so each goes at the end of the map
+    if (!std::isnan(values[id]))
+      properties.insert(properties.end(), std::make_pair(names_[id],
+        values[id]));
+  }
+  return properties;
+}
+
+Steps Timeline::get_steps(size_t frame) const
+{
+  Steps steps;
+  steps.reserve(effects_.size());
+  for (size_t e = 0; e < effects_.size(); ++e)
+    steps.push_back(Step{effects_[e].name, get_properties(frame, e)});
+  return steps;
+}
+
+void Timeline::write(std::ostream& out) const
+{
+  const std::streamsize precision = out.precision(10);
+  out << "frame";
+  for (const EffectEntry& entry: effects_) {
+    for (size_t id = entry.first; id < entry.first + entry.count; ++id)
+      out << "\t" << entry.name << "." << names_[id];
+  }
+  out << "\n";
+
+  for (size_t i = 0; i < nframes_; ++i) {
+    out << i;
+    const double* values = get_values(i);
+    for (size_t id = 0; id < names_.size(); ++id) {
+      out << "\t";
+      if (std::isnan(values[id]))
+        out << "-";
+      else
+        out << values[id];
+    }
+    out << "\n";
+  }
+  out.precision(precision);
+}
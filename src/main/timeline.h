@@ -0,0 +1,107 @@
+/** @file timeline.h
+ *  @brief The keyframed properties of the effects, interpolated for every
+ *         frame ahead of time.
+ */
+#ifndef LAPSE_TIMELINE_H_
+#define LAPSE_TIMELINE_H_
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "planner.h"
+
+/// A set of keyframes is a map from keyframe index to value.
+typedef std::map<int, double> Keyframes;
+/// A set of properties is a map from property names to @a Keyframes.
+typedef std::map<std::string, Keyframes> Properties;
+// Each transformation is mapped to its own @a Properties.
+typedef std::map<std::string, Properties> EffectsMap;
+/// Keep both maps to keyframes and the order in which transformations appeared.
+struct Effects {
+  /// The mapping from transformation names, to properties, to keyframes.
+  EffectsMap                map;
+  /// The order in which the transformations first appeared.
+  std::vector<std::string>  order;
+};
+
+/** @brief The properties of all the effects, for every frame.
+ *
+ *  Each property of each effect gets an integer ID, and the interpolated
+ *  values are stored in one dense array, a row per frame and a column per
+ *  ID, so finding the properties for a frame is a matter of indexing instead
+ *  of searching the keyframes. The properties of an effect have consecutive
+ *  IDs, in alphabetical order, and the effects come in the order in which
+ *  they are applied.
+ *
+ *  A property has no value (it is NaN in the array) in the frames before its
+ *  first keyframe; after the last keyframe, it keeps its last value.
+ *
+ *  The timeline doesn't change once it is built, so any number of threads
+ *  can read it at the same time without locking.
+ */
+class Timeline {
+ public:
+  /// Constructor, for an empty timeline.
+  Timeline() : nframes_(0) {}
+  /// Constructor, interpolating @a effects for frames 0 to @a nframes - 1.
+  Timeline(const Effects& effects, size_t nframes);
+
+  /// Get the number of frames.
+  size_t get_frame_count() const { return nframes_; }
+  /// Get the number of effects.
+  size_t get_effect_count() const { return effects_.size(); }
+  /// Get the name of an effect.
+  const std::string& get_effect_name(size_t effect) const
+    { return effects_[effect].name; }
+  /// Get the total number of properties, for all effects.
+  size_t get_property_count() const { return names_.size(); }
+
+  /// Get the ID of the first property of an effect.
+  size_t get_first_property(size_t effect) const
+    { return effects_[effect].first; }
+  /// Get the number of properties of an effect.
+  size_t get_property_count(size_t effect) const
+    { return effects_[effect].count; }
+  /// Get the name of a property, without the name of the effect.
+  const std::string& get_property_name(size_t id) const { return names_[id]; }
+  /// Get the ID of a property of an effect, or -1 if there is none.
+  int find_property(const std::string& effect, const std::string& name) const;
+
+  /// Get the values of all the properties in a frame, indexed by ID.
+  const double* get_values(size_t frame) const
+    { return values_.data() + frame*names_.size(); }
+  /// Get the value of a property in a frame; this is NaN if it has none.
+  double get_value(size_t frame, size_t id) const
+    { return values_[frame*names_.size() + id]; }
+
+  /// Check whether two frames have the same values for all the properties.
+  bool same_values(size_t frame1, size_t frame2) const;
+
+  /// Get the properties of an effect that have values in a frame.
+  PropertyMap get_properties(size_t frame, size_t effect) const;
+  /// Get the steps for a frame: each effect, with its properties.
+  Steps get_steps(size_t frame) const;
+
+  /** @brief Write the timeline as tab-separated text.
+   *
+   *  There is a column for each property, named @a effect.property, and a
+   *  row for each frame; properties with no value are written as @a -.
+   */
+  void write(std::ostream& out) const;
+
+ private:
+  // an effect, with the range of IDs of its properties
+  struct EffectEntry {
+    std::string   name;
+    size_t        first, count;
+  };
+
+  size_t                      nframes_;
+  std::vector<EffectEntry>    effects_;
+  std::vector<std::string>    names_;
+  std::vector<double>         values_;
+};
+
+#endif
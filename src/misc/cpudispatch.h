@@ -0,0 +1,118 @@
+/** @file cpudispatch.h
+ *  @brief Selection of pixel kernels based on the features of the CPU.
+ */
+#ifndef MISC_CPUDISPATCH_H_
+#define MISC_CPUDISPATCH_H_
+
+#include <cstdlib>
+#include <string>
+
+// compilers that support per-function target attributes can build kernels for
+// instruction sets newer than the ones enabled for the rest of the program
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define LAPSE_CPU_DISPATCH 1
+/// Compile a function for AVX2.
+#define LAPSE_TARGET_AVX2 __attribute__((target("avx2")))
+/// Compile a function for AVX-512 (foundation and byte/word instructions).
+#define LAPSE_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define LAPSE_CPU_DISPATCH 0
+#define LAPSE_TARGET_AVX2
+#define LAPSE_TARGET_AVX512
+#endif
+
+/// Instruction set levels for which kernels can be compiled.
+enum CpuLevel {
+  /// What the program was compiled for (SSE2 on x86-64).
+  CPU_BASELINE = 0,
+  CPU_AVX2,
+  CPU_AVX512
+};
+
+/** @brief Detects the instruction sets supported by the CPU, and decides
+ *         which kernel variants to use.
+ *
+ *  The choice can be overridden by setting the environment variable
+ *  @a LAPSE_CPU to "sse2" (or "baseline"), "avx2", or "avx512". This is
+ *  meant for comparing the variants on the same machine; asking for a level
+ *  that the CPU doesn't support falls back to the best supported one.
+ *
+ *  Kernels are typically written once, as inline functions, and compiled
+ *  for each level by wrapping them in functions marked with
+ *  @a LAPSE_TARGET_AVX2 or @a LAPSE_TARGET_AVX512; @a select then picks the
+ *  right wrapper.
+ */
+class CpuDispatch {
+ public:
+  /// Get the shared instance.
+  static const CpuDispatch& getInstance() {
+    static CpuDispatch instance;
+    return instance;
+  }
+
+  /// Get the best level supported by the CPU.
+  CpuLevel getDetectedLevel() const { return detected_; }
+  /// Get the level used for the kernels.
+  CpuLevel getLevel() const { return level_; }
+  /// Get the value of @a LAPSE_CPU, or an empty string if it wasn't set.
+  const std::string& getOverride() const { return override_; }
+
+  /// Get a short name for a level.
+  static const char* getLevelName(CpuLevel level) {
+    switch (level) {
+      case CPU_AVX2:    return "avx2";
+      case CPU_AVX512:  return "avx512";
+      default:
+#if defined(__SSE2__) || defined(__x86_64__)
+        return "sse2";
+#else
+        return "baseline";
+#endif
+    }
+  }
+
+  /// Choose the variant of a kernel corresponding to the current level.
+  template <class F>
+  F select(F baseline, F avx2, F avx512) const {
+    switch (level_) {
+      case CPU_AVX512:  return avx512;
+      case CPU_AVX2:    return avx2;
+      default:          return baseline;
+    }
+  }
+
+ private:
+  CpuDispatch() : detected_(detect_()), level_(detected_) {
+    const char* env = std::getenv("LAPSE_CPU");
+    if (!env)
+      return;
+
+    override_ = env;
+    CpuLevel requested = detected_;
+    if (override_ == "sse2" || override_ == "baseline")
+      requested = CPU_BASELINE;
+    else if (override_ == "avx2")
+      requested = CPU_AVX2;
+    else if (override_ == "avx512")
+      requested = CPU_AVX512;
+    level_ = (requested < detected_)?requested:detected_;
+  }
+
+  static CpuLevel detect_() {
+#if LAPSE_CPU_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+      return CPU_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+      return CPU_AVX2;
+#endif
+    return CPU_BASELINE;
+  }
+
+  CpuLevel      detected_;
+  CpuLevel      level_;
+  std::string   override_;
+};
+
+#endif
@@ -0,0 +1,315 @@
+/** @file perfcounters.h
+ *  @brief Hardware performance counters, measured around the stages of the
+ *         processing.
+ */
+#ifndef MISC_PERFCOUNTERS_H_
+#define MISC_PERFCOUNTERS_H_
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <boost/thread.hpp>
+
+#include "trace.h"
+
+/** @brief Counts CPU events (cycles, instructions, cache and branch misses,
+ *         page faults) and adds them up for each stage of the processing.
+ *
+ *  This uses perf_event_open, so it only works on Linux, and only for the
+ *  counters that the kernel and the CPU make available (virtual machines
+ *  often have none of the hardware ones). Counters that can't be opened are
+ *  reported as missing; if none can be opened, the stages are not measured.
+ *
+ *  The counters cover the whole process: they are inherited by the threads
+ *  started after they are opened, which includes the workers of the thread
+ *  pool and of the resizer as long as counting is turned on before any
+ *  processing is done. The stages should therefore not overlap in time,
+ *  except by nesting (a resize pass inside an effect, for instance), and a
+ *  nested stage is counted both on its own and as part of its parent.
+ *
+ *  Counting is off by default; when it is, a stage costs one test of a flag.
+ */
+class PerfCounters {
+ public:
+  /// The events that are counted.
+  enum Counter {
+    CYCLES = 0, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, PAGE_FAULTS,
+    NCOUNTERS
+  };
+
+  /// Counts for each event; -1 for the events that are not counted.
+  struct Values {
+    Values() { for (size_t i = 0; i < NCOUNTERS; ++i) counts[i] = -1; }
+
+    int64_t   counts[NCOUNTERS];
+  };
+
+  /// Get the shared instance.
+  static PerfCounters& getInstance() {
+    static PerfCounters instance;
+    return instance;
+  }
+
+  /// Get a short name for a counter.
+  static const char* getCounterName(Counter c) {
+    static const char* names[NCOUNTERS] = {"cycles", "instructions",
+      "llc_misses", "branch_misses", "page_faults"};
+    return names[c];
+  }
+
+  /** @brief Open the counters.
+   *
+   *  This returns true if any could be opened; @a getError then says which
+   *  couldn't. Call this from the main thread before processing starts.
+   */
+  bool setEnabled(bool b);
+  /// Check whether stages are being measured.
+  bool isEnabled() const { return enabled_; }
+  /// Get a description of the counters that could not be opened.
+  const std::string& getError() const { return error_; }
+
+  /// Read the current value of all the counters.
+  Values read() const;
+
+  /// Add the counts for a run of a stage to its totals.
+  void addStage(const std::string& name, const Values& counts);
+
+  /** @brief Write a table with the totals for each stage.
+   *
+   *  Nested stages are included in the totals of the stages around them.
+   */
+  void writeSummary(std::ostream& out) const;
+
+ private:
+  struct Totals {
+    Totals() : runs(0) {}
+
+    size_t    runs;
+    Values    values;
+  };
+
+  PerfCounters() : enabled_(false) {
+    for (size_t i = 0; i < NCOUNTERS; ++i)
+      fds_[i] = -1;
+  }
+  ~PerfCounters() { close_(); }
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+
+  void close_();
+
+  bool                            enabled_;
+  int                             fds_[NCOUNTERS];
+  std::string                     error_;
+  mutable boost::mutex            mutex_;
+  /// The totals for each stage, in the order they first ran.
+  std::map<std::string, Totals>   totals_;
+  std::vector<std::string>        order_;
+};
+
+/** @brief Measures the counters from its construction to its destruction,
+ *         if counting is on.
+ *
+ *  The counts go to the totals for the stage, and to the arguments of
+ *  @a span, if one is given, so that they show up in the trace. The span
+ *  has to outlive the stage. As with @a TraceSpan, the name is only copied
+ *  when counting is on.
+ */
+class PerfStage {
+ public:
+  /// Constructor.
+  explicit PerfStage(const char* name, TraceSpan* span = 0)
+      : span_(span), running_(false) {
+    PerfCounters& counters = PerfCounters::getInstance();
+    if (counters.isEnabled()) {
+      name_ = name;
+      start_ = counters.read();
+      running_ = true;
+    }
+  }
+  /// Destructor, adding up the counts.
+  ~PerfStage() { end(); }
+
+  /// End the stage before the destructor is called.
+  void end() {
+    if (!running_)
+      return;
+    running_ = false;
+    PerfCounters& counters = PerfCounters::getInstance();
+    PerfCounters::Values counts = counters.read();
+    std::ostringstream args;
+    for (size_t i = 0; i < PerfCounters::NCOUNTERS; ++i) {
+      if (counts.counts[i] < 0 || start_.counts[i] < 0) {
+        counts.counts[i] = -1;
+        continue;
+      }
+      counts.counts[i] -= start_.counts[i];
+      args << (args.tellp() > 0?", ":"") << "\""
+           << PerfCounters::getCounterName(PerfCounters::Counter(i))
+           << "\": " << counts.counts[i];
+    }
+    counters.addStage(name_, counts);
+    if (span_)
+      span_ -> setArgs(args.str());
+  }
+
+ private:
+  PerfStage(const PerfStage&);
+  PerfStage& operator=(const PerfStage&);
+
+  std::string             name_;
+  TraceSpan*              span_;
+  bool                    running_;
+  PerfCounters::Values    start_;
+};
+
+inline bool PerfCounters::setEnabled(bool b)
+{
+  close_();
+  enabled_ = false;
+  error_.clear();
+  if (!b)
+    return false;
+
+#ifdef __linux__
+  static const uint32_t types[NCOUNTERS] = {PERF_TYPE_HARDWARE,
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+    PERF_TYPE_SOFTWARE};
+  static const uint64_t configs[NCOUNTERS] = {PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_PAGE_FAULTS};
+  for (size_t i = 0; i < NCOUNTERS; ++i) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[i];
+    attr.config = configs[i];
+    // only user space, which is what unprivileged users are allowed
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // count the threads started later too
+    attr.inherit = 1;
+    // the counters may have to share the hardware; these are needed to
+    // scale the counts when they do
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+      PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fds_[i] < 0) {
+      error_ += std::string(error_.empty()?"":"; ") + getCounterName(
+        Counter(i)) + ": " + strerror(errno);
+    } else {
+      enabled_ = true;
+    }
+  }
+#else
+  error_ = "performance counters are only supported on Linux";
+#endif
+  return enabled_;
+}
+
+inline PerfCounters::Values PerfCounters::read() const
+{
+  Values values;
+#ifdef __linux__
+  for (size_t i = 0; i < NCOUNTERS; ++i) {
+    if (fds_[i] < 0)
+      continue;
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (::read(fds_[i], data, sizeof(data)) != (ssize_t)sizeof(data))
+      continue;
+    if (data[2] > 0 && data[2] < data[1])
+      values.counts[i] = int64_t((double)data[0]*data[1]/data[2]);
+    else
+      values.counts[i] = data[0];
+  }
+#endif
+  return values;
+}
+
+inline void PerfCounters::addStage(const std::string& name,
+    const Values& counts)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  std::map<std::string, Totals>::iterator it = totals_.find(name);
+  if (it == totals_.end()) {
+    it = totals_.insert(std::make_pair(name, Totals())).first;
+    order_.push_back(name);
+  }
+  Totals& totals = it -> second;
+  ++totals.runs;
+  for (size_t i = 0; i < NCOUNTERS; ++i) {
+    if (counts.counts[i] < 0)
+      continue;
+    totals.values.counts[i] = std::max(int64_t(0), totals.values.counts[i]) +
+      counts.counts[i];
+  }
+}
+
+inline void PerfCounters::writeSummary(std::ostream& out) const
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  const std::ios::fmtflags flags = out.flags();
+  const std::streamsize precision = out.precision();
+  size_t width = 5;
+  for (size_t i = 0; i < order_.size(); ++i)
+    width = std::max(width, order_[i].size());
+
+  out << std::left << std::setw(width) << "stage" << std::right
+      << std::setw(6) << "runs";
+  for (size_t i = 0; i < NCOUNTERS; ++i)
+    out << std::setw(15) << getCounterName(Counter(i));
+  out << std::setw(6) << "ipc" << "\n";
+
+  for (size_t k = 0; k < order_.size(); ++k) {
+    const Totals& totals = totals_.find(order_[k]) -> second;
+    const int64_t* counts = totals.values.counts;
+    out << std::left << std::setw(width) << order_[k] << std::right
+        << std::setw(6) << totals.runs;
+    for (size_t i = 0; i < NCOUNTERS; ++i) {
+      if (counts[i] < 0)
+        out << std::setw(15) << "-";
+      else
+        out << std::setw(15) << counts[i];
+    }
+    // instructions per cycle
+    if (counts[CYCLES] > 0 && counts[INSTRUCTIONS] >= 0) {
+      out << std::setw(6) << std::fixed << std::setprecision(2)
+          << (double)counts[INSTRUCTIONS]/counts[CYCLES];
+    } else {
+      out << std::setw(6) << "-";
+    }
+    out << "\n";
+  }
+  out.flags(flags);
+  out.precision(precision);
+  out << std::flush;
+}
+
+inline void PerfCounters::close_()
+{
+#ifdef __linux__
+  for (size_t i = 0; i < NCOUNTERS; ++i) {
+    if (fds_[i] >= 0)
+      close(fds_[i]);
+    fds_[i] = -1;
+  }
+#endif
+}
+
+#endif
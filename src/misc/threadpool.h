@@ -0,0 +1,208 @@
+/** @file threadpool.h
+ *  @brief A process-wide pool of worker threads.
+ */
+#ifndef MISC_THREADPOOL_H_
+#define MISC_THREADPOOL_H_
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "trace.h"
+
+/** @brief A pool of worker threads that can be shared by all the pixel
+ *         kernels.
+ *
+ *  Starting threads is not free, and it is wasteful to do it once per call
+ *  for operations that are repeated for every frame. This class keeps a set
+ *  of threads alive and hands them ranges of work to do.
+ *
+ *  Nested use is allowed: a thread waiting for its sub-tasks to complete
+ *  helps with the work in the queue instead of blocking.
+ */
+class ThreadPool {
+ public:
+  /// A function working on the range [@a begin, @a end).
+  typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+  /** @brief Get the shared instance.
+   *
+   *  This uses as many threads as the number of hardware threads on the
+   *  machine.
+   */
+  static ThreadPool& getInstance() {
+    static ThreadPool instance;
+    return instance;
+  }
+
+  /** @brief Constructor.
+   *
+   *  Use 0 for @a n to use as many threads as the number of hardware threads
+   *  on the machine.
+   */
+  explicit ThreadPool(size_t n = 0) : stop_(false) {
+    if (n == 0)
+      n = std::max(1u, boost::thread::hardware_concurrency());
+    // the calling thread also does work, so we need one less worker
+    for (size_t i = 1; i < n; ++i) {
+      threads_.push_back(boost::shared_ptr<boost::thread>(
+        new boost::thread(&ThreadPool::work_, this)));
+    }
+  }
+  /// Destructor. This waits for the tasks in the queue to finish.
+  ~ThreadPool() {
+    {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wakeup_.notify_all();
+    for (size_t i = 0; i < threads_.size(); ++i)
+      threads_[i] -> join();
+  }
+
+  /// Get the number of threads, including the calling thread.
+  size_t getThreadCount() const { return threads_.size() + 1; }
+
+  /** @brief Split the range [0, @a n) into pieces, and process them in
+   *         parallel.
+   *
+   *  Each piece has at least @a minChunk elements. At most @a maxThreads
+   *  threads are used, or @a getThreadCount if @a maxThreads is 0. The
+   *  function returns after all the pieces were processed. If any of the
+   *  calls to @a fct throws, the first exception is rethrown here.
+   */
+  void parallelFor(size_t n, const RangeFunction& fct, size_t minChunk = 1,
+      size_t maxThreads = 0);
+
+ private:
+  /// Keeps track of the pieces of one call to @a parallelFor.
+  struct Batch {
+    Batch() : pending(0) {}
+
+    size_t              pending;
+    std::exception_ptr  error;
+  };
+
+  /// A piece of work.
+  struct Task {
+    RangeFunction   fct;
+    size_t          begin;
+    size_t          end;
+    Batch*          batch;
+  };
+
+  // non-copyable
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  /// Run a task and update its batch. Call this without holding the lock.
+  void run_(const Task& task);
+  /// Worker thread loop.
+  void work_();
+
+  std::vector<boost::shared_ptr<boost::thread> >  threads_;
+  std::deque<Task>                                tasks_;
+  boost::mutex                                    mutex_;
+  /// Signaled when tasks are added, or when the pool is stopped.
+  boost::condition_variable                       wakeup_;
+  /// Signaled when a task is finished.
+  boost::condition_variable                       finished_;
+  bool                                            stop_;
+};
+
+inline void ThreadPool::run_(const Task& task)
+{
+  std::exception_ptr error;
+  TraceSpan span("pool", "task");
+  try {
+    task.fct(task.begin, task.end);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  span.end();
+
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    if (error && !task.batch -> error)
+      task.batch -> error = error;
+    --task.batch -> pending;
+  }
+  finished_.notify_all();
+}
+
+inline void ThreadPool::work_()
+{
+  for (;;) {
+    Task task;
+    {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (!stop_ && tasks_.empty())
+        wakeup_.wait(lock);
+      if (tasks_.empty())
+        return;
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+    run_(task);
+  }
+}
+
+inline void ThreadPool::parallelFor(size_t n, const RangeFunction& fct,
+    size_t minChunk, size_t maxThreads)
+{
+  if (n == 0)
+    return;
+
+  // don't have more pieces than threads, or pieces smaller than minChunk
+  size_t nPieces = getThreadCount();
+  if (maxThreads > 0)
+    nPieces = std::min(nPieces, maxThreads);
+  nPieces = std::max(size_t(1), std::min(nPieces, n/std::max(size_t(1),
+    minChunk)));
+
+  if (nPieces == 1) {
+    fct(0, n);
+    return;
+  }
+
+  Batch batch;
+  const double step = (double)n / nPieces;
+  {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    // the first piece is done by the calling thread
+    for (size_t i = 1; i < nPieces; ++i) {
+      Task task = {fct, size_t(i*step), (i + 1 < nPieces)?size_t((i+1)*step):n,
+        &batch};
+      tasks_.push_back(task);
+    }
+    batch.pending = nPieces;
+  }
+  wakeup_.notify_all();
+
+  Task first = {fct, 0, size_t(step), &batch};
+  run_(first);
+
+  // help with the queue while waiting; this is what makes nested calls safe
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  while (batch.pending > 0) {
+    if (!tasks_.empty()) {
+      Task task = tasks_.front();
+      tasks_.pop_front();
+      lock.unlock();
+      run_(task);
+      lock.lock();
+    } else {
+      finished_.wait(lock);
+    }
+  }
+
+  if (batch.error)
+    std::rethrow_exception(batch.error);
+}
+
+#endif
@@ -47,7 +47,7 @@ class FrequencyCounter {
    *           is averaged.
    */
   explicit FrequencyCounter(double d = 2.0) : delayReset_(d*1000000),
-    countReset_(0) { }
+    countReset_(0), totalCount_(0) { }
 
   /** @brief Constructor with averaging done over @a n repetitions.
    *
@@ -55,12 +55,12 @@ class FrequencyCounter {
    *           averaged over @a n repetitions.
    */
   explicit FrequencyCounter(size_t n) : delayReset_(0.),
-    countReset_(n) { }
+    countReset_(n), totalCount_(0) { }
   /** @brief Constructor with averaging done either over @a d seconds or @a n
    *         repetitions, whichever takes longer.
    */
   FrequencyCounter(double d, size_t n) : delayReset_(d*1000000),
-    countReset_(n) { }
+    countReset_(n), totalCount_(0) { }
 
   /// Get the averaging time for the frequency.
   double getDelayReset() const { return delayReset_ / 1000000.0;  }// us -> s
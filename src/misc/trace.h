@@ -0,0 +1,180 @@
+/** @file trace.h
+ *  @brief Recording of timed spans, for viewing in a trace viewer.
+ */
+#ifndef MISC_TRACE_H_
+#define MISC_TRACE_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "timer.h"
+
+/** @brief Collects the spans of time spent in each stage of the processing.
+ *
+ *  The spans are written in the Chrome trace-event format, which can be
+ *  loaded in Perfetto or chrome://tracing, with one track per thread. This
+ *  shows where the time goes, and whether the stages that are meant to run
+ *  in parallel actually overlap.
+ *
+ *  Tracing is off by default; when it is, recording a span costs one test of
+ *  a flag.
+ */
+class Tracer {
+ public:
+  /// Get the shared instance.
+  static Tracer& getInstance() {
+    static Tracer instance;
+    return instance;
+  }
+
+  /** @brief Turn tracing on or off.
+   *
+   *  This should be done by the main thread, before the spans to be traced
+   *  start, and not while other threads are recording spans.
+   */
+  void setEnabled(bool b) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    // the thread turning tracing on gets the first track
+    getThreadId_();
+    enabled_ = b;
+  }
+  /// Check whether tracing is on.
+  bool isEnabled() const { return enabled_; }
+
+  /// Get the time in microseconds since the tracer was created.
+  long now() const { return clock_.getElapsedUsec(); }
+
+  /** @brief Record a span for the calling thread.
+   *
+   *  @a start is a time given by @a now, and @a duration is in
+   *  microseconds. @a args, if not empty, are the members of a JSON object
+   *  with more information about the span, such as @a "\"pixels\": 1000".
+   */
+  void addSpan(const std::string& name, const char* category, long start,
+      long duration, const std::string& args = std::string()) {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    const Event event = {name, category, start, duration,
+      getThreadId_(), args};
+    events_.push_back(event);
+  }
+
+  /// Get the number of spans recorded.
+  size_t getSpanCount() const {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    return events_.size();
+  }
+
+  /// Write the spans in the Chrome trace-event format.
+  void write(std::ostream& out) const {
+    boost::lock_guard<boost::mutex> lock(mutex_);
+    out << "{\"traceEvents\": [\n";
+    // name the threads, in the order they were first seen
+    for (size_t i = 0; i < threadIds_.size(); ++i) {
+      out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+          << "\"tid\": " << i << ", \"args\": {\"name\": \""
+          << (i == 0?"main":"thread " + std::to_string(i)) << "\"}},\n";
+    }
+    for (size_t i = 0; i < events_.size(); ++i) {
+      const Event& e = events_[i];
+      out << "{\"name\": \"" << escape_(e.name) << "\", \"cat\": \""
+          << e.category << "\", \"ph\": \"X\", \"ts\": " << e.start
+          << ", \"dur\": " << e.duration << ", \"pid\": 1, \"tid\": "
+          << e.thread;
+      if (!e.args.empty())
+        out << ", \"args\": {" << e.args << "}";
+      out << "}" << (i + 1 < events_.size()?",":"") << "\n";
+    }
+    out << "], \"displayTimeUnit\": \"ms\"}\n";
+  }
+
+ private:
+  struct Event {
+    std::string   name;
+    const char*   category;
+    long          start, duration;
+    size_t        thread;
+    std::string   args;
+  };
+
+  Tracer() : enabled_(false) {}
+  Tracer(const Tracer&);
+  Tracer& operator=(const Tracer&);
+
+  // small number identifying the calling thread; call with the lock held
+  size_t getThreadId_() {
+    const boost::thread::id id = boost::this_thread::get_id();
+    for (size_t i = 0; i < threadIds_.size(); ++i) {
+      if (threadIds_[i] == id)
+        return i;
+    }
+    threadIds_.push_back(id);
+    return threadIds_.size() - 1;
+  }
+
+  // escape a string for JSON
+  static std::string escape_(const std::string& s) {
+    std::string result;
+    for (size_t i = 0; i < s.size(); ++i) {
+      if (s[i] == '"' || s[i] == '\\')
+        result += '\\';
+      if ((unsigned char)s[i] >= 0x20)
+        result += s[i];
+    }
+    return result;
+  }
+
+  bool                              enabled_;
+  Timer                             clock_;
+  mutable boost::mutex              mutex_;
+  std::vector<Event>                events_;
+  std::vector<boost::thread::id>    threadIds_;
+};
+
+/** @brief Records a span from its construction to its destruction, if
+ *         tracing is on.
+ *
+ *  The name is only copied when tracing is on, so spans with fixed names
+ *  cost nothing otherwise. Names that have to be built should only be built
+ *  when @a Tracer::isEnabled (or @a PerfCounters::isEnabled, for a
+ *  @a PerfStage with the same name) says they will be used.
+ */
+class TraceSpan {
+ public:
+  /// Constructor. The @a category has to be a string literal.
+  TraceSpan(const char* category, const char* name)
+      : category_(category), start_(-1) {
+    Tracer& tracer = Tracer::getInstance();
+    if (tracer.isEnabled()) {
+      name_ = name;
+      start_ = tracer.now();
+    }
+  }
+  /// Destructor, recording the span.
+  ~TraceSpan() { end(); }
+
+  /// Set more information about the span; see @a Tracer::addSpan.
+  void setArgs(const std::string& args) { args_ = args; }
+
+  /// End the span before the destructor is called.
+  void end() {
+    if (start_ < 0)
+      return;
+    Tracer& tracer = Tracer::getInstance();
+    tracer.addSpan(name_, category_, start_, tracer.now() - start_, args_);
+    start_ = -1;
+  }
+
+ private:
+  TraceSpan(const TraceSpan&);
+  TraceSpan& operator=(const TraceSpan&);
+
+  const char*   category_;
+  std::string   name_;
+  std::string   args_;
+  long          start_;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Compare the speed of the 8-bit and 16-bit processing paths on the same job.
+#
+# usage: bench-depth.sh LAPSE FIRST LAST [RUNS [EFFECTS]]
+#
+# LAPSE is the lapse executable, FIRST and LAST the first and last input
+# files, as for lapse itself. The job is run RUNS times (default 5) with
+# each of --depth 8 and --depth 16, alternating between the two so that
+# both see the same conditions, and the median time per frame reported by
+# lapse is printed for each, along with the ratio. EFFECTS are the
+# keyframes, as for the -e option; the default uses all the effects that
+# have a 16-bit path.
+
+set -e
+
+if [ $# -lt 3 ]; then
+  echo "usage: $0 LAPSE FIRST LAST [RUNS [EFFECTS]]" >&2
+  exit 1
+fi
+
+LAPSE=$1
+FIRST=$2
+LAST=$3
+RUNS=${4:-5}
+EFFECTS=${5:-"0: exposure.evrel=0.5 whitebalance.temp=4500 lens.k1=-0.05 \
+lens.v1=-0.2 cropresize.twidth=1280 cropresize.theight=720 \
+pad.target_w=1320 pad.target_h=760"}
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# run the job once, printing the time per frame in milliseconds
+run() {
+  "$LAPSE" --depth "$1" -e "$EFFECTS" "$FIRST" "$LAST" \
+    -o "$OUT/frame_XXXX.jpg" |
+  sed -n 's/^Processed .*(\([0-9.e+-]*\) ms per frame)\.$/\1/p'
+}
+
+# print the median of the numbers in a file, one per line
+median() {
+  sort -n "$1" | awk '{ v[NR] = $1 }
+    END { print (NR % 2)?v[(NR + 1)/2]:(v[NR/2] + v[NR/2 + 1])/2 }'
+}
+
+: > "$OUT/times8"
+: > "$OUT/times16"
+i=0
+while [ $i -lt "$RUNS" ]; do
+  run 8 >> "$OUT/times8"
+  run 16 >> "$OUT/times16"
+  i=$((i + 1))
+done
+
+T8=$(median "$OUT/times8")
+T16=$(median "$OUT/times16")
+echo "median over $RUNS runs, in ms per frame:"
+echo "  8 bits: $T8"
+echo "  16 bits: $T16"
+awk -v a="$T8" -v b="$T16" 'BEGIN { printf "  16 bits / 8 bits: %.2f\n", b/a }'
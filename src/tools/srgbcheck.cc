@@ -0,0 +1,130 @@
+/** @file srgbcheck.cc
+ *  @brief Check the sRGB exposure tables against LCMS.
+ *
+ *  The exposure effect changes the exposure of sRGB images in CIE XYZ with
+ *  a table per frame (see @a makeSrgbScaleTable), instead of converting each
+ *  image to XYZ and back with LCMS. This compares the two, for a few
+ *  exposure changes, on all the gray levels and a fixed pseudo-random sample
+ *  of a million colors, at 8 and 16 bits.
+ *
+ *  At 8 bits, the results should be within one level of each other, which
+ *  allows for values that fall right between two levels, where the rounding
+ *  depends on the float noise in LCMS; such values should also be rare (at
+ *  most 2% of them). At 16 bits, LCMS itself is only accurate to a few
+ *  levels, so up to 4 levels (less than 0.01%) are allowed, for any number of
+ *  values. The program prints the differences for each exposure change and
+ *  returns a non-zero status if the tolerance is exceeded.
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <stdint.h>
+
+#include "color/lcmswrapper.h"
+#include "color/srgb.h"
+
+namespace {  // anonymous namespace
+
+// the largest difference allowed, in levels
+template <class T> int max_difference();
+template <> int max_difference<unsigned char>() { return 1; }
+template <> int max_difference<uint16_t>() { return 4; }
+// the largest fraction of values allowed to differ
+template <class T> double max_fraction();
+template <> double max_fraction<unsigned char>() { return 0.02; }
+template <> double max_fraction<uint16_t>() { return 1; }
+
+/** @brief Make the pixels to check: every gray level, followed by colors
+ *         from a fixed linear congruential generator, so that runs are
+ *         reproducible.
+ */
+template <class T>
+std::vector<T> make_pixels()
+{
+  const unsigned max = std::numeric_limits<T>::max();
+  std::vector<T> pixels;
+  for (unsigned v = 0; v <= max; ++v)
+    pixels.insert(pixels.end(), 3, v);
+  uint32_t state = 1;
+  for (size_t i = 0; i < 3*1000000; ++i) {
+    state = state*1664525 + 1013904223;
+    pixels.push_back((state >> 16) & max);
+  }
+  return pixels;
+}
+
+/** @brief Check the table for @a factor on the sRGB pixels @a pixels.
+ *
+ *  The pixels are also converted to XYZ, multiplied by @a factor, and
+ *  converted back, with LCMS. Returns whether the results are within the
+ *  tolerance.
+ */
+template <class T>
+bool check(const std::vector<T>& pixels, double factor, double ev)
+{
+  const bool is8 = (sizeof(T) == 1);
+  const int rgb_type = is8?TYPE_RGB_8:TYPE_RGB_16;
+  ColorProfile srgb = ColorProfileFactory::fromBuiltin("sRGB");
+  ColorProfile xyz = ColorProfileFactory::fromBuiltin("XYZ");
+  ColorTransform to_xyz = ColorTransformFactory::fromProfiles(srgb, rgb_type,
+    xyz, TYPE_XYZ_FLT, INTENT_PERCEPTUAL);
+  ColorTransform from_xyz = ColorTransformFactory::fromProfiles(xyz,
+    TYPE_XYZ_FLT, srgb, rgb_type, INTENT_PERCEPTUAL);
+
+  const size_t npixels = pixels.size()/3;
+  std::vector<float> xyz_values(pixels.size());
+  to_xyz.apply(pixels.begin(), xyz_values.begin(), npixels);
+  for (size_t i = 0; i < xyz_values.size(); ++i)
+    xyz_values[i] *= factor;
+  std::vector<T> reference(pixels.size());
+  from_xyz.apply(xyz_values.begin(), reference.begin(), npixels);
+
+  std::vector<T> table(size_t(std::numeric_limits<T>::max()) + 1);
+  makeSrgbScaleTable(factor, &table[0]);
+
+  int largest = 0;
+  size_t ndiffer = 0;
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    const int diff = std::abs((int)table[pixels[i]] - (int)reference[i]);
+    largest = std::max(largest, diff);
+    if (diff > 0)
+      ++ndiffer;
+  }
+
+  const double fraction = (double)ndiffer/pixels.size();
+  const bool ok = (largest <= max_difference<T>() &&
+    fraction <= max_fraction<T>());
+  std::cout << (is8?" 8":"16") << " bits, EV " << std::showpos
+            << std::setw(5) << ev << std::noshowpos << ": largest difference "
+            << largest << ", " << ndiffer << " of " << pixels.size()
+            << " values differ" << (ok?"":" -- FAILED") << std::endl;
+  return ok;
+}
+
+} // anonymous namespace
+
+int main()
+{
+  const double evs[] = {-3, -1, -0.5, -0.1, 0.1, 0.33, 1, 2.5};
+
+  const std::vector<unsigned char> pixels8 = make_pixels<unsigned char>();
+  const std::vector<uint16_t> pixels16 = make_pixels<uint16_t>();
+
+  bool ok = true;
+  for (double ev: evs) {
+    ok = check(pixels8, std::pow(2, ev), ev) && ok;
+    ok = check(pixels16, std::pow(2, ev), ev) && ok;
+  }
+
+  if (!ok) {
+    std::cout << "The tables differ from LCMS by more than the tolerance."
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+/** @file boxreducer.h
+ *  @brief Fast reduction of images by integer factors, by averaging blocks of
+ *         pixels.
+ */
+#ifndef TRANSFORMS_BOXREDUCER_H_
+#define TRANSFORMS_BOXREDUCER_H_
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <stdint.h>
+
+#include "image/image.h"
+#include "misc/cpudispatch.h"
+
+namespace boxreducer_detail {
+
+/// Type used to add up pixel values.
+template <class T> struct Accumulator { typedef float type; };
+template <> struct Accumulator<unsigned char> { typedef uint32_t type; };
+template <> struct Accumulator<unsigned short> { typedef uint32_t type; };
+
+/// Average of @a n values adding up to @a sum, rounded to nearest.
+inline uint32_t average(uint32_t sum, uint32_t n) { return (sum + n/2) / n; }
+/// Average of @a n values adding up to @a sum.
+inline float average(float sum, uint32_t n) { return sum / n; }
+
+// add a row of values to the accumulator; this is where most of the time goes
+template <class T, class Acc>
+inline void addRow(const T* src, size_t n, Acc* acc)
+{
+  for (size_t i = 0; i < n; ++i)
+    acc[i] += src[i];
+}
+
+template <class T, class Acc>
+LAPSE_TARGET_AVX2 void addRowAvx2(const T* src, size_t n, Acc* acc)
+{
+  addRow(src, n, acc);
+}
+
+template <class T, class Acc>
+LAPSE_TARGET_AVX512 void addRowAvx512(const T* src, size_t n, Acc* acc)
+{
+  addRow(src, n, acc);
+}
+
+template <class T, class Acc>
+void addRowDispatch(const T* src, size_t n, Acc* acc)
+{
+  typedef void (*Kernel)(const T*, size_t, Acc*);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &addRow<T, Acc>, &addRowAvx2<T, Acc>, &addRowAvx512<T, Acc>);
+  kernel(src, n, acc);
+}
+
+} // namespace boxreducer_detail
+
+/** @brief Reduce the size of an image by integer factors @a kx, @a ky, by
+ *         averaging blocks of pixels.
+ *
+ *  Pixel @a i of the output is the average of the source pixels
+ *  i*k - (k-1)/2 to i*k + k/2 (rounding (k-1)/2 down), clipped to the image,
+ *  so that its center matches the source position i*k for odd @a k, and is
+ *  half a source pixel further for even @a k. This is the same position
+ *  convention as that of @a Resizer: output pixel @a i corresponds to source
+ *  position i*k. The output has size ceil(width/kx) x ceil(height/ky).
+ *
+ *  The pixel values are added up in integers (for 8- and 16-bit images), so
+ *  the factors are limited to 255 in each direction.
+ *
+ *  The output is always interleaved. The source can have any layout, but
+ *  this is fastest for interleaved images.
+ */
+template <class T>
+GenericImage<T> boxReduce(const GenericImage<T>& image, size_t kx, size_t ky)
+{
+  typedef typename boxreducer_detail::Accumulator<T>::type Acc;
+
+  if (kx < 1 || ky < 1 || kx > 255 || ky > 255)
+    throw std::runtime_error("[boxReduce] Reduction factors should be between "
+      "1 and 255.");
+
+  const size_t width = image.getWidth();
+  const size_t height = image.getHeight();
+  const size_t ncomps = image.getChannelCount();
+
+  GenericImage<T> result;
+  result.reshape((width + kx - 1)/kx, (height + ky - 1)/ky);
+  result.setChannelCount(ncomps);
+  result.allocate();
+
+  const int* strides = image.getStrides();
+  const int channelStride = image.getChannelStride();
+  const bool contiguous = (strides[0] == (int)ncomps &&
+    (ncomps == 1 || channelStride == 1));
+
+  std::vector<Acc> acc(width*ncomps);
+  std::vector<T> buffer(contiguous?0:width*ncomps);
+  for (size_t j = 0; j < result.getHeight(); ++j) {
+    // add up the rows in the block
+    const size_t y0 = std::max(0, (int)(j*ky) - (int)((ky - 1)/2));
+    const size_t y1 = std::min(height, j*ky + ky/2 + 1);
+    std::fill(acc.begin(), acc.end(), Acc());
+    for (size_t y = y0; y < y1; ++y) {
+      const T* src = image(0, y);
+      if (!contiguous) {
+        for (size_t x = 0; x < width; ++x)
+          for (size_t k = 0; k < ncomps; ++k)
+            buffer[x*ncomps + k] = src[x*strides[0] + k*channelStride];
+        src = &buffer[0];
+      }
+      boxreducer_detail::addRowDispatch(src, width*ncomps, &acc[0]);
+    }
+
+    // then add up horizontally, and normalize
+    T* dest = result(0, j);
+    for (size_t i = 0; i < result.getWidth(); ++i) {
+      const size_t x0 = std::max(0, (int)(i*kx) - (int)((kx - 1)/2));
+      const size_t x1 = std::min(width, i*kx + kx/2 + 1);
+      const uint32_t n = (x1 - x0)*(y1 - y0);
+      for (size_t k = 0; k < ncomps; ++k) {
+        Acc sum = Acc();
+        for (size_t x = x0; x < x1; ++x)
+          sum += acc[x*ncomps + k];
+        dest[i*ncomps + k] = boxreducer_detail::average(sum, n);
+      }
+    }
+  }
+
+  result.copyMetadataFrom(image);
+  // (setting the channel types also sets the channel count)
+  if (!image.getChannelTypes().empty())
+    result.setChannelTypes(image.getChannelTypes());
+
+  return result;
+}
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "sampler.h"
 #include "convsampler.h"
+#include "kerneltable.h"
 
 /// A 2d sampler that uses a box filter.
 // XXX this relies on the user to not call setLut[XYs]... It seems annoying
@@ -22,7 +23,7 @@ class BoxSampler : public ConvolutionSampler<T> {
   BoxSampler()
   {
     ConvolutionSampler<T>::setSize(0.5, 0.5);
-    ConvolutionSampler<T>::setLuts(std::vector<float>(1, 1.0));
+    ConvolutionSampler<T>::setTables(KernelTables::getInstance().getBox());
   }
 };
 
@@ -7,12 +7,19 @@
 #include "convsampler.h"
 
 #include "image/image-impl.h"
+#include "image/quantize.h"
 
+// when the channel count N is known at compile time, all the channels are
+// accumulated in a single pass over the neighbors; otherwise (N = 0) there is
+// one pass per channel
 template <class T>
+template <size_t N>
 void ConvolutionSampler<T>::getProduct_(const GenericImage<T>& image, float x,
     float y, T* where, float scalex, float scaley) const
 {
-  const unsigned ncomps = image.getChannelCount();
+  const unsigned ncomps = (N > 0)?N:image.getChannelCount();
+  const unsigned npasses = (N > 0)?1:ncomps;
+  const unsigned nacc = (N > 0)?N:1;
 
   float sizeX = sizeX_*scalex;
   float sizeY = sizeY_*scaley;
@@ -36,8 +43,10 @@ void ConvolutionSampler<T>::getProduct_(const GenericImage<T>& image, float x,
     (int)std::floor(y + sizeY));
 
   // lengths of the look-up tables
-  const unsigned flenX = lutX_.size();
-  const unsigned flenY = lutY_.size();
+  const std::vector<float>& lutX = tableX_ -> getValues();
+  const std::vector<float>& lutY = tableY_ -> getValues();
+  const unsigned flenX = lutX.size();
+  const unsigned flenY = lutY.size();
 
   // scale factors to map from image-space distances to positions in look-up
   // tables
@@ -48,9 +57,9 @@ void ConvolutionSampler<T>::getProduct_(const GenericImage<T>& image, float x,
   const float shiftedX = x + sizeX;
   const float shiftedY = y + sizeY;
 
-  for (unsigned comp = 0; comp < ncomps; ++comp) {
+  for (unsigned comp = 0; comp < npasses; ++comp) {
     // calculate the contributions from all the relevant neighbors
-    float value = 0;
+    float value[(N > 0)?N:1] = {};
     // keep track of the sum of weights; this is to make sure that a uniform
     // image always gets sampled as a uniform image, avoiding any sampling
     // errors
@@ -64,24 +73,28 @@ void ConvolutionSampler<T>::getProduct_(const GenericImage<T>& image, float x,
 //        const float shiftedDistY = shiftedY - j;
 //        const unsigned mapj = shiftedDistY*mapfactorY;
 
-        const float weight = lutX_[(int)mapi]*lutY_[(int)mapj];
-        value += image(i, j)[comp]*weight;
+        const float weight = lutX[(int)mapi]*lutY[(int)mapj];
+        const T* p = image(i, j) + comp;
+        for (unsigned k = 0; k < nacc; ++k)
+          value[k] += p[k]*weight;
         wsum += weight;
       }
     }
     
-    value /= wsum;
-    // clamp to allowed values
-    // this is a static member, but it's shorter to write the call this way
-    where[comp] = image.clampColor(value);
+    // round and clamp to allowed values
+    for (unsigned k = 0; k < nacc; ++k)
+      where[comp + k] = quantize<T>(value[k] / wsum);
   }
 }
 
 template <class T>
+template <size_t N>
 void ConvolutionSampler<T>::getX_(const GenericImage<T>& image, float x,
     float y, T* where, float scalex) const
 {
-  const unsigned ncomps = image.getChannelCount();
+  const unsigned ncomps = (N > 0)?N:image.getChannelCount();
+  const unsigned npasses = (N > 0)?1:ncomps;
+  const unsigned nacc = (N > 0)?N:1;
 
   float sizeX = sizeX_*scalex;
 
@@ -100,7 +113,8 @@ void ConvolutionSampler<T>::getX_(const GenericImage<T>& image, float x,
   const int valY = y;
 
   // length of the horizontal look-up table
-  const unsigned flenX = lutX_.size();
+  const std::vector<float>& lutX = tableX_ -> getValues();
+  const unsigned flenX = lutX.size();
 
   // scale factor to map from image-space distances to position in look-up
   // table
@@ -109,9 +123,9 @@ void ConvolutionSampler<T>::getX_(const GenericImage<T>& image, float x,
   // cache shifted x value
   const float shiftedX = x + sizeX;
 
-  for (unsigned comp = 0; comp < ncomps; ++comp) {
+  for (unsigned comp = 0; comp < npasses; ++comp) {
     // calculate the contributions from all the relevant neighbors
-    float value = 0;
+    float value[(N > 0)?N:1] = {};
     // keep track of the sum of weights; this is to make sure that a uniform
     // image always gets sampled as a uniform image, avoiding any sampling
     // errors
@@ -121,23 +135,27 @@ void ConvolutionSampler<T>::getX_(const GenericImage<T>& image, float x,
 //      const float shiftedDistX = shiftedX - i;
 //      const unsigned mapi = shiftedDistX*mapfactorX;
 
-      const float weight = lutX_[(int)mapi];
-      value += image(i, valY)[comp]*weight;
+      const float weight = lutX[(int)mapi];
+      const T* p = image(i, valY) + comp;
+      for (unsigned k = 0; k < nacc; ++k)
+        value[k] += p[k]*weight;
       wsum += weight;
     }
     
-    value /= wsum;
-    // clamp to allowed values
-    // this is a static member, but it's shorter to write the call this way
-    where[comp] = image.clampColor(value);
+    // round and clamp to allowed values
+    for (unsigned k = 0; k < nacc; ++k)
+      where[comp + k] = quantize<T>(value[k] / wsum);
   }
 }
 
 template <class T>
+template <size_t N>
 void ConvolutionSampler<T>::getY_(const GenericImage<T>& image, float x,
     float y, T* where, float scaley) const
 {
-  const unsigned ncomps = image.getChannelCount();
+  const unsigned ncomps = (N > 0)?N:image.getChannelCount();
+  const unsigned npasses = (N > 0)?1:ncomps;
+  const unsigned nacc = (N > 0)?N:1;
 
   float sizeY = sizeY_*scaley;
 
@@ -155,8 +173,9 @@ void ConvolutionSampler<T>::getY_(const GenericImage<T>& image, float x,
     (int)std::floor(y + sizeY));
   const int valX = x;
 
-  // length of the horizontal look-up table
-  const unsigned flenY = lutY_.size();
+  // length of the vertical look-up table
+  const std::vector<float>& lutY = tableY_ -> getValues();
+  const unsigned flenY = lutY.size();
 
   // scale factor to map from image-space distances to position in look-up
   // table
@@ -165,9 +184,9 @@ void ConvolutionSampler<T>::getY_(const GenericImage<T>& image, float x,
   // cache shifted x value
   const float shiftedY = y + sizeY;
 
-  for (unsigned comp = 0; comp < ncomps; ++comp) {
+  for (unsigned comp = 0; comp < npasses; ++comp) {
     // calculate the contributions from all the relevant neighbors
-    float value = 0;
+    float value[(N > 0)?N:1] = {};
     // keep track of the sum of weights; this is to make sure that a uniform
     // image always gets sampled as a uniform image, avoiding any sampling
     // errors
@@ -177,15 +196,16 @@ void ConvolutionSampler<T>::getY_(const GenericImage<T>& image, float x,
 //      const float shiftedDistY = shiftedY - j;
 //      const unsigned mapj = shiftedDistY*mapfactorY;
 
-      const float weight = lutY_[(int)mapj];
-      value += image(valX, j)[comp]*weight;
+      const float weight = lutY[(int)mapj];
+      const T* p = image(valX, j) + comp;
+      for (unsigned k = 0; k < nacc; ++k)
+        value[k] += p[k]*weight;
       wsum += weight;
     }
     
-    value /= wsum;
-    // clamp to allowed values
-    // this is a static member, but it's shorter to write the call this way
-    where[comp] = image.clampColor(value);
+    // round and clamp to allowed values
+    for (unsigned k = 0; k < nacc; ++k)
+      where[comp + k] = quantize<T>(value[k] / wsum);
   }
 }
 
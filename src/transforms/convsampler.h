@@ -9,13 +9,15 @@
 
 #include <cmath>
 
+#include "kerneltable.h"
 #include "sampler.h"
 
 /** @brief Sampler that performs 2d or 1d convolutions.
  *
  *  The function that the convolution is performed with is assumed to be a
  *  product, fct(x, y) = f1(x)*f2(y), and each term in the product is read from
- *  a look-up table (for efficiency).
+ *  a look-up table (for efficiency). The tables are immutable, and are
+ *  usually shared with other samplers (see @a KernelTables).
  *
  *  The sampler can apply the convolution in both directions, or only
  *  horizontally or vertically, in which case the other direction just uses
@@ -30,8 +32,8 @@ class ConvolutionSampler : public BaseSampler<T> {
    *
    *  The default sampler just returns the nearest pixel value.
    */
-  ConvolutionSampler() : lutX_(1, 1), lutY_(1, 1), sizeX_(0.5),
-      sizeY_(0.5) {}
+  ConvolutionSampler() : tableX_(KernelTables::getInstance().getBox()),
+      tableY_(tableX_), sizeX_(0.5), sizeY_(0.5) {}
 
   /** @brief Sample the picture.
    *
@@ -46,17 +48,43 @@ class ConvolutionSampler : public BaseSampler<T> {
       Direction dir = BaseSampler<T>::BOTH, float scalex = 1, float scaley = 1)
       const;
 
+  /** @brief Sample an image with @a N channels (0 for any number), in
+   *         direction @a Dir.
+   *
+   *  Unlike @a get, this is not virtual, and it doesn't need to check the
+   *  channel count or the direction. When the type of the sampler is known
+   *  at compile time, it can be inlined into the caller's loop.
+   */
+  template <size_t N, Direction Dir>
+  void sample(const GenericImage<T>& image, float x, float y, T* where,
+      float scalex = 1, float scaley = 1) const
+    { get_<N>(image, x, y, where, Dir, scalex, scaley); }
+
   /// Update the horizontal look-up table.
-  void setLutX(const std::vector<float>& newlut) { lutX_ = newlut; }
+  void setLutX(const std::vector<float>& newlut)
+    { tableX_.reset(new KernelTable(newlut)); }
   /// Update the vertical look-up table.
-  void setLutY(const std::vector<float>& newlut) { lutY_ = newlut; }
+  void setLutY(const std::vector<float>& newlut)
+    { tableY_.reset(new KernelTable(newlut)); }
   /// Update both look-up tables with the same vector.
-  void setLuts(const std::vector<float>& newlut) { lutX_ = lutY_ = newlut; }
+  void setLuts(const std::vector<float>& newlut)
+    { tableX_ = tableY_ = KernelTablePtr(new KernelTable(newlut)); }
+
+  /// Use a shared table for the horizontal direction.
+  void setTableX(const KernelTablePtr& table) { tableX_ = table; }
+  /// Use a shared table for the vertical direction.
+  void setTableY(const KernelTablePtr& table) { tableY_ = table; }
+  /// Use the same shared table for both directions.
+  void setTables(const KernelTablePtr& table) { tableX_ = tableY_ = table; }
 
   /// Look at the horizontal look-up table.
-  const std::vector<float>& getLutX() const { return lutX_; }
+  const std::vector<float>& getLutX() const { return tableX_ -> getValues(); }
   /// Look at the vertical look-up table.
-  const std::vector<float>& getLutY() const { return lutY_; }
+  const std::vector<float>& getLutY() const { return tableY_ -> getValues(); }
+  /// Get the horizontal table, so that it can be shared.
+  const KernelTablePtr& getTableX() const { return tableX_; }
+  /// Get the vertical table, so that it can be shared.
+  const KernelTablePtr& getTableY() const { return tableY_; }
 
   /// Set the filter image size.
   void setSize(float x, float y) { sizeX_ = x; sizeY_ = y; }
@@ -70,31 +98,43 @@ class ConvolutionSampler : public BaseSampler<T> {
   float getSizeY() const { return sizeY_; }
 
  protected:
+  /** @brief Sample an image with @a N channels.
+   *
+   *  With @a N > 0, the channel loops have a fixed length, so the compiler can
+   *  unroll them; @a N = 0 works with any number of channels.
+   */
+  template <size_t N>
+  void get_(const GenericImage<T>& image, float x, float y, T* where,
+    Direction dir, float scalex, float scaley) const;
+
   /// Get using a product of the filter with itself.
+  template <size_t N>
   void getProduct_(const GenericImage<T>& image, float x, float y, T*,
     float scalex, float scaley) const;
   
   /// Get using the filter only horizontally.
+  template <size_t N>
   void getX_(const GenericImage<T>& image, float x, float y, T* where,
     float scalex) const;
   /// Get using the filter only vertically.
+  template <size_t N>
   void getY_(const GenericImage<T>& image, float x, float y, T* where,
     float scaley) const;
 
   /** @brief Filter look-up table for the horizontal direction.
    *
    *  Position @a x + @a dx in image space is mapped to
-   *  (@a dx + @a sizeX_)*@a lutX_.size() / (2*@a sizeX_)
-   *  in this vector.
+   *  (@a dx + @a sizeX_)*@a tableX_->size() / (2*@a sizeX_)
+   *  in this table.
    */
-  std::vector<float>   lutX_;
+  KernelTablePtr        tableX_;
   /** @brief Filter look-up table for the vertical direction.
    *
    *  Position @a y + @a dy in image space is mapped to
-   *  (@a dy + @a sizeY_)*@a lutY_.size() / (2*@a sizeY_)
-   *  in this vector.
+   *  (@a dy + @a sizeY_)*@a tableY_->size() / (2*@a sizeY_)
+   *  in this table.
    */
-  std::vector<float>   lutY_;
+  KernelTablePtr        tableY_;
   /** @brief Horizontal "radius" of the filter on the image.
    *
    *  The filter goes from @a x - @a sizeX_ (inclusive) to @a x + @a sizeX_
@@ -113,16 +153,38 @@ class ConvolutionSampler : public BaseSampler<T> {
 template <class T>
 inline void ConvolutionSampler<T>::get(const GenericImage<T>& image, float x,
     float y, T* where, Direction dir, float scalex, float scaley) const
+{
+  // almost all images have 3 channels, so it pays to have specialized
+  // versions for the common cases
+  switch (image.getChannelCount()) {
+    case 1:
+      get_<1>(image, x, y, where, dir, scalex, scaley);
+      return;
+    case 3:
+      get_<3>(image, x, y, where, dir, scalex, scaley);
+      return;
+    case 4:
+      get_<4>(image, x, y, where, dir, scalex, scaley);
+      return;
+    default:
+      get_<0>(image, x, y, where, dir, scalex, scaley);
+  }
+}
+
+template <class T>
+template <size_t N>
+inline void ConvolutionSampler<T>::get_(const GenericImage<T>& image, float x,
+    float y, T* where, Direction dir, float scalex, float scaley) const
 {
   switch (dir) {
     case BaseSampler<T>::BOTH:
-      getProduct_(image, x, y, where, scalex, scaley);
+      getProduct_<N>(image, x, y, where, scalex, scaley);
       return;
     case BaseSampler<T>::HORIZONTAL:
-      getX_(image, x, y, where, scalex);
+      getX_<N>(image, x, y, where, scalex);
       return;
     case BaseSampler<T>::VERTICAL:
-      getY_(image, x, y, where, scaley);
+      getY_<N>(image, x, y, where, scaley);
       return;
     default:;
   }
@@ -8,6 +8,7 @@
 
 #include "sampler.h"
 #include "convsampler.h"
+#include "kerneltable.h"
 
 namespace detail_cubic {
 
@@ -34,7 +35,8 @@ class CubicSampler : public ConvolutionSampler<T> {
       unsigned res = 6000) : B_(B), C_(C)
   {
     ConvolutionSampler<T>::setSize(2, 2);
-    ConvolutionSampler<T>::setLuts(detail_cubic::makeLut(B, C, res));
+    ConvolutionSampler<T>::setTables(
+      KernelTables::getInstance().getCubic(B, C, res));
   }
 
   /// Get size of look-up table.
@@ -0,0 +1,68 @@
+#include "kerneltable.h"
+
+#include <boost/thread/locks.hpp>
+
+#include "cubicsampler.h"
+#include "lanczossampler.h"
+#include "linsampler.h"
+
+bool KernelTables::Key::operator<(const Key& other) const
+{
+  if (kind != other.kind) return kind < other.kind;
+  if (p1 != other.p1) return p1 < other.p1;
+  if (p2 != other.p2) return p2 < other.p2;
+  return res < other.res;
+}
+
+KernelTablePtr KernelTables::getBox()
+{
+  return get_(Key{KERNEL_BOX, 0, 0, 1});
+}
+
+KernelTablePtr KernelTables::getLinear(unsigned res)
+{
+  return get_(Key{KERNEL_LINEAR, 0, 0, res});
+}
+
+KernelTablePtr KernelTables::getCubic(float B, float C, unsigned res)
+{
+  return get_(Key{KERNEL_CUBIC, B, C, res});
+}
+
+KernelTablePtr KernelTables::getLanczos(float order, unsigned res)
+{
+  return get_(Key{KERNEL_LANCZOS, order, 0, res});
+}
+
+size_t KernelTables::size() const
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+  return tables_.size();
+}
+
+KernelTablePtr KernelTables::get_(const Key& key)
+{
+  boost::lock_guard<boost::mutex> lock(mutex_);
+
+  KernelTablePtr& table = tables_[key];
+  if (!table) {
+    switch (key.kind) {
+      case KERNEL_BOX:
+        table.reset(new KernelTable(std::vector<float>(1, 1.0)));
+        break;
+      case KERNEL_LINEAR:
+        table.reset(new KernelTable(detail_linear::makeLut(key.res)));
+        break;
+      case KERNEL_CUBIC:
+        table.reset(new KernelTable(detail_cubic::makeLut(key.p1, key.p2,
+          key.res)));
+        break;
+      case KERNEL_LANCZOS:
+        table.reset(new KernelTable(detail_lanczos::makeLut(key.p1,
+          key.res)));
+        break;
+    }
+  }
+
+  return table;
+}
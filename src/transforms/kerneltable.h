@@ -0,0 +1,80 @@
+/** @file kerneltable.h
+ *  @brief Look-up tables for filter kernels, shared by all the samplers.
+ */
+#ifndef TRANSFORMS_KERNELTABLE_H_
+#define TRANSFORMS_KERNELTABLE_H_
+
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/// An immutable look-up table for a filter kernel.
+class KernelTable {
+ public:
+  /// Constructor.
+  explicit KernelTable(const std::vector<float>& values) : values_(values) {}
+
+  /// Get the kernel values.
+  const std::vector<float>& getValues() const { return values_; }
+
+  /// Get the number of entries in the table.
+  size_t size() const { return values_.size(); }
+
+ private:
+  std::vector<float>      values_;
+};
+
+/// A pointer to a shared kernel table.
+typedef boost::shared_ptr<const KernelTable> KernelTablePtr;
+
+/** @brief A process-wide registry of kernel tables.
+ *
+ *  Each table is built the first time it is asked for, and then shared by
+ *  all the samplers that use the same kernel, parameters and resolution.
+ *  Since the tables are never modified, they can be used from any thread.
+ */
+class KernelTables {
+ public:
+  /// Get the shared instance.
+  static KernelTables& getInstance() {
+    static KernelTables instance;
+    return instance;
+  }
+
+  /// Table for a box filter.
+  KernelTablePtr getBox();
+  /// Table for a linear (triangular) filter.
+  KernelTablePtr getLinear(unsigned res);
+  /// Table for a Mitchell-Netravali cubic filter.
+  KernelTablePtr getCubic(float B, float C, unsigned res);
+  /// Table for a Lanczos filter.
+  KernelTablePtr getLanczos(float order, unsigned res);
+
+  /// Get the number of tables that have been built.
+  size_t size() const;
+
+ private:
+  enum Kind { KERNEL_BOX, KERNEL_LINEAR, KERNEL_CUBIC, KERNEL_LANCZOS };
+
+  struct Key {
+    Kind      kind;
+    float     p1, p2;
+    unsigned  res;
+
+    bool operator<(const Key& other) const;
+  };
+
+  KernelTables() {}
+  KernelTables(const KernelTables&);
+  KernelTables& operator=(const KernelTables&);
+
+  /// Find a table, or build it.
+  KernelTablePtr get_(const Key& key);
+
+  mutable boost::mutex              mutex_;
+  std::map<Key, KernelTablePtr>     tables_;
+};
+
+#endif
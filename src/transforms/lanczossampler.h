@@ -8,6 +8,7 @@
 
 #include "sampler.h"
 #include "convsampler.h"
+#include "kerneltable.h"
 
 namespace detail_lanczos {
 
@@ -35,7 +36,8 @@ class LanczosSampler : public ConvolutionSampler<T> {
   explicit LanczosSampler(float order = 3, unsigned res = 6000) : order_(order)
   {
     ConvolutionSampler<T>::setSize(order, order);
-    ConvolutionSampler<T>::setLuts(detail_lanczos::makeLut(order, res));
+    ConvolutionSampler<T>::setTables(
+      KernelTables::getInstance().getLanczos(order, res));
   }
 
   /// Get size of look-up table.
@@ -8,6 +8,7 @@
 
 #include "sampler.h"
 #include "convsampler.h"
+#include "kerneltable.h"
 
 namespace detail_linear {
 
@@ -29,7 +30,8 @@ class LinearSampler : public ConvolutionSampler<T> {
   explicit LinearSampler(unsigned res = 6000)
   {
     ConvolutionSampler<T>::setSize(1, 1);
-    ConvolutionSampler<T>::setLuts(detail_linear::makeLut(res));
+    ConvolutionSampler<T>::setTables(
+      KernelTables::getInstance().getLinear(res));
   }
 
   /// Get size of look-up table.
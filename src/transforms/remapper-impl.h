@@ -0,0 +1,158 @@
+/** @file remapper-impl.h
+ *  @brief Implementation of the remapping of images.
+ */
+#ifndef TRANSFORMS_REMAPPER_IMPL_H_
+#define TRANSFORMS_REMAPPER_IMPL_H_
+
+#include <limits>
+
+#include "remapper.h"
+
+#include "image/image-impl.h"
+#include "misc/cpudispatch.h"
+#include "misc/threadpool.h"
+
+namespace remapper_detail {
+
+/// Type used for the interpolation.
+template <class T> struct Accumulator { typedef uint64_t type; };
+template <> struct Accumulator<unsigned char> { typedef uint32_t type; };
+
+// remap rows [y1, y2) of the output, for N channels (0 for any number); with
+// Gain, the gains are applied too
+template <size_t N, bool Gain, class T>
+inline void remapRows(const RemapTable& table, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t y1, size_t y2)
+{
+  typedef typename Accumulator<T>::type Acc;
+  const int fracBits = RemapTable::fracBits;
+  const int gainBits = RemapTable::gainBits;
+  const Acc one = Acc(1) << fracBits;
+  const Acc maxValue = std::numeric_limits<T>::max();
+
+  const size_t width = table.getWidth();
+  const size_t ncomps = (N > 0)?N:image.getChannelCount();
+  // (keeping the strides in locals: the compiler can't tell that writing
+  // the output doesn't change them)
+  const T* src = image(0, 0);
+  const int pixelStride = image.getStrides()[0];
+  const int rowStride = image.getStrides()[1];
+  const int destStride = result.getStrides()[0];
+  for (size_t j = y1; j < y2; ++j) {
+    const RemapTable::Entry* entry = &table.getEntries()[j*width];
+    const uint16_t* gain = Gain?&table.getGains()[j*width]:0;
+    T* dest = result(0, j);
+    for (size_t i = 0; i < width; ++i, dest += destStride) {
+      const RemapTable::Entry e = entry[i];
+      if (e.x == RemapTable::outside) {
+        std::fill(dest, dest + ncomps, T());
+        continue;
+      }
+      const T* p00 = src + e.y*rowStride + e.x*pixelStride;
+      const T* p10 = p00 + pixelStride;
+      const T* p01 = p00 + rowStride;
+      const T* p11 = p01 + pixelStride;
+      for (size_t k = 0; k < ncomps; ++k) {
+        const Acc top = p00[k]*(one - e.fx) + p10[k]*Acc(e.fx);
+        const Acc bottom = p01[k]*(one - e.fx) + p11[k]*Acc(e.fx);
+        const Acc v = top*(one - e.fy) + bottom*e.fy;
+        if (Gain) {
+          // drop some of the fractional bits first, to stay within 32 bits
+          // for 8-bit images
+          const Acc scaled = ((v + (one >> 1)) >> fracBits)*gain[i];
+          const Acc out = (scaled + (Acc(1) << (fracBits + gainBits - 1))) >>
+            (fracBits + gainBits);
+          dest[k] = std::min(out, maxValue);
+        } else {
+          dest[k] = (v + (Acc(1) << (2*fracBits - 1))) >> (2*fracBits);
+        }
+      }
+    }
+  }
+}
+
+template <size_t N, bool Gain, class T>
+LAPSE_TARGET_AVX2 void remapRowsAvx2(const RemapTable& table,
+    const GenericImage<T>& image, GenericImage<T>& result, size_t y1,
+    size_t y2)
+{
+  remapRows<N, Gain>(table, image, result, y1, y2);
+}
+
+template <size_t N, bool Gain, class T>
+LAPSE_TARGET_AVX512 void remapRowsAvx512(const RemapTable& table,
+    const GenericImage<T>& image, GenericImage<T>& result, size_t y1,
+    size_t y2)
+{
+  remapRows<N, Gain>(table, image, result, y1, y2);
+}
+
+// choose the variant of the loop for this CPU
+template <size_t N, bool Gain, class T>
+void remapDispatch(const RemapTable& table, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t y1, size_t y2)
+{
+  typedef void (*Kernel)(const RemapTable&, const GenericImage<T>&,
+    GenericImage<T>&, size_t, size_t);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &remapRows<N, Gain, T>, &remapRowsAvx2<N, Gain, T>,
+    &remapRowsAvx512<N, Gain, T>);
+  kernel(table, image, result, y1, y2);
+}
+
+// choose the loop for the channel count
+template <bool Gain, class T>
+void remapTyped(const RemapTable& table, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t y1, size_t y2)
+{
+  switch (image.getChannelCount()) {
+    case 1: remapDispatch<1, Gain>(table, image, result, y1, y2); break;
+    case 3: remapDispatch<3, Gain>(table, image, result, y1, y2); break;
+    case 4: remapDispatch<4, Gain>(table, image, result, y1, y2); break;
+    default: remapDispatch<0, Gain>(table, image, result, y1, y2);
+  }
+}
+
+} // namespace remapper_detail
+
+template <class T>
+void RemapTable::apply(const GenericImage<T>& image, GenericImage<T>& result,
+    size_t maxThreads) const
+{
+  if (image.getWidth() != srcWidth_ || image.getHeight() != srcHeight_ ||
+      result.getWidth() != width_ || result.getHeight() != height_)
+    throw std::runtime_error("[RemapTable::apply] Image size does not match "
+      "the table.");
+  if (result.getChannelCount() != image.getChannelCount())
+    throw std::runtime_error("[RemapTable::apply] Channel count mismatch "
+      "between origin and destination image.");
+
+  // the kernel accesses the channels of each pixel directly, so it needs
+  // interleaved images
+  if (image.getLayout() != LAYOUT_INTERLEAVED) {
+    GenericImage<T> flat(image);
+    flat.flatten();
+    apply(flat, result, maxThreads);
+    return;
+  }
+  if (result.getLayout() != LAYOUT_INTERLEAVED) {
+    GenericImage<T> flat;
+    flat.reshape(width_, height_);
+    flat.setChannelCount(result.getChannelCount());
+    flat.allocate();
+    apply(image, flat, maxThreads);
+    result.copyPixelsFrom(flat);
+    return;
+  }
+
+  const bool gain = !gains_.empty();
+  ThreadPool::getInstance().parallelFor(height_,
+    [&](size_t y1, size_t y2) {
+      if (gain)
+        remapper_detail::remapTyped<true>(*this, image, result, y1, y2);
+      else
+        remapper_detail::remapTyped<false>(*this, image, result, y1, y2);
+    }, 4, maxThreads);
+}
+
+#endif
@@ -0,0 +1,131 @@
+/** @file remapper.h
+ *  @brief Precomputed per-pixel remapping of images.
+ */
+#ifndef TRANSFORMS_REMAPPER_H_
+#define TRANSFORMS_REMAPPER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <stdint.h>
+
+#include "image/image.h"
+
+/** @brief A map from each output pixel to a source position, with an
+ *         optional gain for each pixel.
+ *
+ *  This is for transformations that are too irregular to calculate on the
+ *  fly for every frame, such as lens distortion: the table is built once,
+ *  and then applied to any number of images with a single streaming pass,
+ *  using bilinear interpolation.
+ *
+ *  The source positions are stored as the integer coordinates of the top-left
+ *  pixel of the 2x2 neighborhood and the interpolation weights, with
+ *  @a fracBits fractional bits, so the table takes 8 bytes per pixel (plus 2
+ *  if there are gains). Source images are limited to 65535 pixels in each
+ *  direction, and have to be at least 2x2.
+ */
+class RemapTable {
+ public:
+  /// Number of fractional bits in the interpolation weights.
+  static const int fracBits = 8;
+  /// Number of fractional bits in the gains.
+  static const int gainBits = 12;
+  /// Value of @a Entry::x for output pixels that map outside the source.
+  static const uint16_t outside = 0xffff;
+
+  /// Where an output pixel comes from.
+  struct Entry {
+    /// Top-left source pixel.
+    uint16_t  x, y;
+    /// Weights of the pixels to the right and below, out of 1 << fracBits.
+    uint16_t  fx, fy;
+  };
+
+  /** @brief Constructor, for a source of size @a srcWidth x @a srcHeight and
+   *         an output of size @a width x @a height.
+   *
+   *  All the output pixels initially map outside the source.
+   */
+  RemapTable(size_t srcWidth, size_t srcHeight, size_t width, size_t height)
+      : srcWidth_(srcWidth), srcHeight_(srcHeight), width_(width),
+        height_(height), entries_(width*height, Entry{outside, 0, 0, 0}) {
+    if (srcWidth < 2 || srcHeight < 2 || srcWidth > outside ||
+        srcHeight > outside)
+      throw std::runtime_error("[RemapTable::RemapTable] Unsupported source "
+        "image size.");
+  }
+
+  /** @brief Set the source position for output pixel (@a i, @a j).
+   *
+   *  Positions are those of pixel centers. Positions within half a pixel of
+   *  the source image are clamped to its edge; those further away leave the
+   *  output pixel black.
+   */
+  void set(size_t i, size_t j, double x, double y) {
+    Entry& entry = entries_[j*width_ + i];
+    if (x < -0.5 || y < -0.5 || x >= srcWidth_ - 0.5 ||
+        y >= srcHeight_ - 0.5) {
+      entry = Entry{outside, 0, 0, 0};
+      return;
+    }
+    entry = Entry{0, 0, 0, 0};
+    setAxis_(x, srcWidth_, entry.x, entry.fx);
+    setAxis_(y, srcHeight_, entry.y, entry.fy);
+  }
+
+  /** @brief Set the gain for output pixel (@a i, @a j).
+   *
+   *  The gain is limited to less than 16. Pixels whose gain was never set
+   *  have gain 1.
+   */
+  void setGain(size_t i, size_t j, double gain) {
+    if (gains_.empty())
+      gains_.assign(width_*height_, 1 << gainBits);
+    const double g = std::floor(gain*(1 << gainBits) + 0.5);
+    gains_[j*width_ + i] = std::max(0.0, std::min(g, 65535.0));
+  }
+
+  /** @brief Remap @a image into @a result.
+   *
+   *  @a image must have the source size given to the constructor, and
+   *  @a result the output size and the same number of channels. Only
+   *  integer pixel types are supported.
+   */
+  template <class T>
+  void apply(const GenericImage<T>& image, GenericImage<T>& result,
+    size_t maxThreads = 0) const;
+
+  /// Get the width of the source.
+  size_t getSourceWidth() const { return srcWidth_; }
+  /// Get the height of the source.
+  size_t getSourceHeight() const { return srcHeight_; }
+  /// Get the width of the output.
+  size_t getWidth() const { return width_; }
+  /// Get the height of the output.
+  size_t getHeight() const { return height_; }
+  /// Get the entries, row by row.
+  const std::vector<Entry>& getEntries() const { return entries_; }
+  /// Get the gains, row by row; this is empty if no gain was set.
+  const std::vector<uint16_t>& getGains() const { return gains_; }
+
+ private:
+  // split a position into a pixel and a weight; the pixel is chosen so that
+  // its neighbor is still inside the image
+  static void setAxis_(double x, size_t size, uint16_t& pixel,
+      uint16_t& weight) {
+    x = std::max(0.0, std::min(x, size - 1.0));
+    const size_t p = std::min((size_t)x, size - 2);
+    pixel = p;
+    weight = std::floor((x - p)*(1 << fracBits) + 0.5);
+  }
+
+  size_t                  srcWidth_, srcHeight_;
+  size_t                  width_, height_;
+  std::vector<Entry>      entries_;
+  std::vector<uint16_t>   gains_;
+};
+
+#endif
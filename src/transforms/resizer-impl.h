@@ -5,17 +5,47 @@
 #define TRANSFORMS_RESIZER_IMPL_H_
 
 #include <algorithm>
+#include <cmath>
+#include <functional>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include "resizer.h"
 
+#include "boxreducer.h"
 #include "convsampler-impl.h"
+#include "misc/cpudispatch.h"
+#include "misc/perfcounters.h"
+#include "misc/trace.h"
 
+namespace resizer_detail {
+
+// the filter radius of a sampler of known type
+template <class Sampler>
+bool getSize(const Sampler& sampler, float& sizeX, float& sizeY)
+{
+  sizeX = sampler.getSizeX();
+  sizeY = sampler.getSizeY();
+  return true;
+}
+
+// the filter radius of a sampler chosen at run time, if it can be found
 template <class T>
-GenericImage<T> Resizer<T>::resize(const GenericImage<T>& image, unsigned width,
-    unsigned height)
+bool getSize(const BaseSampler<T>& sampler, float& sizeX, float& sizeY)
+{
+  const ConvolutionSampler<T>* conv =
+    dynamic_cast<const ConvolutionSampler<T>*>(&sampler);
+  if (!conv)
+    return false;
+  return getSize(*conv, sizeX, sizeY);
+}
+
+} // namespace resizer_detail
+
+template <class T, class Sampler>
+GenericImage<T> Resizer<T, Sampler>::resize(const GenericImage<T>& image,
+    unsigned width, unsigned height)
 {
 
   if (width == image.getWidth() && height == image.getHeight()) {
@@ -26,37 +56,154 @@ GenericImage<T> Resizer<T>::resize(const GenericImage<T>& image, unsigned width,
     return result;
   }
 
-  float scaleX = (float)width / image.getWidth();
-  float scaleY = (float)height / image.getHeight();
-
   GenericImage<T> result;
   result.reshape(width, height);
   result.setChannelCount(image.getChannelCount());
   result.allocate();
 
+  resize(image, result);
+
+  // copy the metadata
+  result.copyMetadataFrom(image);
+
+  // copy the type
+  result.setChannelTypes(image.getChannelTypes());
+
+  return result;
+}
+
+template <class T, class Sampler>
+void Resizer<T, Sampler>::resize(const GenericImage<T>& image,
+    GenericImage<T>& result)
+{
+  resize(image, 0, 0, image.getWidth(), image.getHeight(), result);
+}
+
+template <class T, class Sampler>
+void Resizer<T, Sampler>::resize(const GenericImage<T>& image, float x0,
+    float y0, float x1, float y1, GenericImage<T>& result)
+{
+  const unsigned width = result.getWidth();
+  const unsigned height = result.getHeight();
+  if (result.getChannelCount() != image.getChannelCount())
+    throw std::runtime_error("[Resizer::resize] Channel count mismatch between "
+      "origin and destination image.");
+  if (!canResize(image.getWidth(), image.getHeight(), x0, y0, x1, y1, width,
+        height))
+    throw std::runtime_error("[Resizer::resize] Source region is empty or "
+      "not inside the image.");
+
+  // the samplers access the channels of each pixel directly, so they need
+  // interleaved images
+  if (image.getLayout() != LAYOUT_INTERLEAVED) {
+    GenericImage<T> flat(image);
+    flat.flatten();
+    resize(flat, x0, y0, x1, y1, result);
+    return;
+  }
+  if (result.getLayout() != LAYOUT_INTERLEAVED) {
+    GenericImage<T> flat;
+    flat.reshape(width, height);
+    flat.setChannelCount(result.getChannelCount());
+    flat.allocate();
+    resize(image, x0, y0, x1, y1, flat);
+    result.copyPixelsFrom(flat);
+    return;
+  }
+
+  resizer_detail::Mapping mapping = {x0, y0, (x1 - x0) / width,
+    (y1 - y0) / height};
+
+  // only the part of the image that the filter can reach is needed
+  GenericImage<T> view(image);
+  float sizeX, sizeY;
+  if (sampler_ && resizer_detail::getSize(*sampler_, sizeX, sizeY)) {
+    const float marginX = sizeX*std::max(mapping.fx, 1.0f) + 1;
+    const float marginY = sizeY*std::max(mapping.fy, 1.0f) + 1;
+    const size_t bx0 = std::max(0.0f, std::floor(x0 - marginX));
+    const size_t by0 = std::max(0.0f, std::floor(y0 - marginY));
+    const size_t bx1 = std::min((float)image.getWidth(),
+      std::ceil(x1 + marginX));
+    const size_t by1 = std::min((float)image.getHeight(),
+      std::ceil(y1 + marginY));
+    view.crop(bx0, by0, bx1 - bx0, by1 - by0);
+    mapping.x0 -= bx0;
+    mapping.y0 -= by0;
+  }
+
+  // whole-pixel shifts without scaling are just crops
+  if (mapping.fx == 1 && mapping.x0 == std::floor(mapping.x0)) {
+    view.crop(mapping.x0, 0);
+    mapping.x0 = 0;
+  }
+  if (mapping.fy == 1 && mapping.y0 == std::floor(mapping.y0)) {
+    view.crop(0, mapping.y0);
+    mapping.y0 = 0;
+  }
+
+  // large reductions can start with a cheap box filter; a direction that is
+  // enlarged (or only slightly reduced) is left alone, with a factor of 1
+  const size_t kx = std::max(size_t(1), std::min((size_t)mapping.fx,
+    size_t(255)));
+  const size_t ky = std::max(size_t(1), std::min((size_t)mapping.fy,
+    size_t(255)));
+  if (preReduction_ && (kx > 1 || ky > 1)) {
+    // the blocks are centered half a pixel off for even factors
+    mapping.x0 = (mapping.x0 - ((kx % 2 == 0)?0.5f:0.0f)) / kx;
+    mapping.y0 = (mapping.y0 - ((ky % 2 == 0)?0.5f:0.0f)) / ky;
+    mapping.fx /= kx;
+    mapping.fy /= ky;
+    resample_(boxReduce(view, kx, ky), result, mapping);
+  } else {
+    resample_(view, result, mapping);
+  }
+
+  if (callback_)
+    (*callback_)(1);
+}
+
+template <class T, class Sampler>
+void Resizer<T, Sampler>::resample_(const GenericImage<T>& image,
+    GenericImage<T>& result, const resizer_detail::Mapping& mapping)
+{
+  const unsigned width = result.getWidth();
+  const unsigned height = result.getHeight();
+
+  const bool scalesX = (mapping.fx != 1 || mapping.x0 != 0);
+  const bool scalesY = (mapping.fy != 1 || mapping.y0 != 0);
+
   pixelsOffset_ = 0;
   totalPixels_ = result.getWidth()*result.getHeight();
 
+  if (!scalesX && !scalesY) {
+    GenericImage<T> view(image);
+    view.crop(0, 0, width, height);
+    result.copyPixelsFrom(view);
+    return;
+  }
+
   // if one of the dimensions stays the same, don't change it
-  if (width == image.getWidth()) {
-    doResize_(image, result, BaseSampler<T>::VERTICAL);
-  } else if (height == image.getHeight()) {
-    doResize_(image, result, BaseSampler<T>::HORIZONTAL);
+  if (!scalesX) {
+    doResize_(image, result, BaseSampler<T>::VERTICAL, mapping);
+  } else if (!scalesY) {
+    doResize_(image, result, BaseSampler<T>::HORIZONTAL, mapping);
   } else {
-    // scale one dimension, then the other; the order here is (i think) based
-    // on speed; i don't know what the best quality would require
+    // scale one dimension, then the other, starting with the one that
+    // shrinks the most
+    const resizer_detail::Mapping mappingX = {mapping.x0, 0, mapping.fx, 1};
+    const resizer_detail::Mapping mappingY = {0, mapping.y0, 1, mapping.fy};
     GenericImage<T> interm;
     interm.setChannelCount(image.getChannelCount());
-    if (scaleX < scaleY) {
+    if (mapping.fx > mapping.fy) {
       interm.reshape(width, image.getHeight());
       interm.allocate();
 
       size_t partialPixels = interm.getWidth()*interm.getHeight();
       totalPixels_ += partialPixels;
 
-      doResize_(image, interm, BaseSampler<T>::HORIZONTAL);
+      doResize_(image, interm, BaseSampler<T>::HORIZONTAL, mappingX);
       pixelsOffset_ = partialPixels;
-      doResize_(interm, result, BaseSampler<T>::VERTICAL);
+      doResize_(interm, result, BaseSampler<T>::VERTICAL, mappingY);
     } else {
       interm.reshape(image.getWidth(), height);
       interm.allocate();
@@ -64,27 +211,17 @@ GenericImage<T> Resizer<T>::resize(const GenericImage<T>& image, unsigned width,
       size_t partialPixels = interm.getWidth()*interm.getHeight();
       totalPixels_ += partialPixels;
 
-      doResize_(image, interm, BaseSampler<T>::VERTICAL);
+      doResize_(image, interm, BaseSampler<T>::VERTICAL, mappingY);
       pixelsOffset_ = partialPixels;
-      doResize_(interm, result, BaseSampler<T>::HORIZONTAL);
+      doResize_(interm, result, BaseSampler<T>::HORIZONTAL, mappingX);
     }
   }
-
-  // copy the metadata
-  result.copyMetadataFrom(image);
-
-  // copy the type
-  result.setChannelTypes(image.getChannelTypes());
-
-  if (callback_)
-    (*callback_)(1);
-
-  return result;
 }
 
-template <class T>
-void Resizer<T>::doResize_(const GenericImage<T>& image,
-    GenericImage<T>& result, typename BaseSampler<T>::Direction dir)
+template <class T, class Sampler>
+void Resizer<T, Sampler>::doResize_(const GenericImage<T>& image,
+    GenericImage<T>& result, typename BaseSampler<T>::Direction dir,
+    const resizer_detail::Mapping& mapping)
 {
   if (!sampler_)
     throw std::runtime_error("[Resizer::resize] No sampler set!");
@@ -92,6 +229,11 @@ void Resizer<T>::doResize_(const GenericImage<T>& image,
   const unsigned width = result.getWidth();
   const unsigned height = result.getHeight();
 
+  const char* pass = (dir == BaseSampler<T>::HORIZONTAL)?"resize horizontal":
+    "resize vertical";
+  TraceSpan span("resize", pass);
+  PerfStage perf(pass, &span);
+
   // have as many threads as the hardware allows, but not more than maxThreads_
   // (and treat maxThreads_ == 0 as maxThreads_ == infinity)
   const size_t hwThreads = boost::thread::hardware_concurrency();
@@ -105,7 +247,7 @@ void Resizer<T>::doResize_(const GenericImage<T>& image,
   pixels_.resize(nThreads);
   std::fill(pixels_.begin(), pixels_.end(), 0);
   if (nThreads == 1) {
-    doResizeST_(image, result, 0, 0, width, height, 0, dir);
+    doResizeST_(image, result, 0, 0, width, height, 0, dir, mapping);
   } else {
     // need to split the image into nThreads parts; do the split in the longest
     // dimension
@@ -123,8 +265,11 @@ void Resizer<T>::doResize_(const GenericImage<T>& image,
         y1 = i*step; y2 = (i + 1)*step;
       }
 
-      threads[i].reset(new boost::thread(&Resizer<T>::doResizeST_, this,
-        image, result, x1, y1, x2, y2, i, dir));
+      // the threads are joined before returning, so references are fine
+      threads[i].reset(new boost::thread([=, &image, &result, &mapping] {
+        TraceSpan strip("resize", pass);
+        doResizeST_(image, result, x1, y1, x2, y2, i, dir, mapping);
+      }));
     }
     
     // wait for the threads to finish
@@ -134,33 +279,189 @@ void Resizer<T>::doResize_(const GenericImage<T>& image,
   }
 }
 
-template <class T>
-void Resizer<T>::doResizeST_(const GenericImage<T>& image,
-    GenericImage<T>& result, size_t resX1, size_t resY1,
-    size_t resX2, size_t resY2, size_t idx,
-    typename BaseSampler<T>::Direction dir)
+namespace resizer_detail {
+
+/// Called after each row of output with the number of pixels done so far;
+/// returning false stops the resizing.
+typedef std::function<bool(size_t)> Progress;
+
+// use the non-virtual sampling function of a sampler of known type
+template <size_t N, int Dir, class T, class Sampler>
+inline void sample(const Sampler& sampler, const GenericImage<T>& image,
+    float x, float y, T* where, float scalex, float scaley)
 {
-  if (!sampler_)
-    throw std::runtime_error("[Resizer::resize] No sampler set!");
+  sampler.template sample<N, (typename BaseSampler<T>::Direction)Dir>(image,
+    x, y, where, scalex, scaley);
+}
 
-  const unsigned width = result.getWidth();
-  const unsigned height = result.getHeight();
-  const float factorX = (float)image.getWidth() / width;
-  const float factorY = (float)image.getHeight() / height;
+// samplers of unknown type have to go through the virtual function
+template <size_t N, int Dir, class T>
+inline void sample(const BaseSampler<T>& sampler, const GenericImage<T>& image,
+    float x, float y, T* where, float scalex, float scaley)
+{
+  sampler.get(image, x, y, where, (typename BaseSampler<T>::Direction)Dir,
+    scalex, scaley);
+}
+
+// the resampling loop, for N channels (0 for any number) in direction Dir
+template <size_t N, int Dir, class T, class Sampler>
+inline bool resampleBlock(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t x1, size_t y1, size_t x2, size_t y2,
+    const Mapping& mapping, const Progress& progress)
+{
+  const float factorX = mapping.fx;
+  const float factorY = mapping.fy;
 
   const float filterScaleX = ((factorX >= 1)?factorX:1);
   const float filterScaleY = ((factorY >= 1)?factorY:1);
 
-  float origi = resX1*factorX, origj;
-  for (unsigned i = resX1; i < resX2; ++i, origi += factorX) {
-    origj = resY1*factorY;
-    for (unsigned j = resY1; j < resY2; ++j, origj += factorY) {
-      sampler_ -> get(image, origi, origj, result(i, j), dir,
-          filterScaleX, filterScaleY);
+  // go row by row, which is friendlier to the caches; the source positions
+  // are accumulated in the same way as when going column by column, so the
+  // results don't depend on the order
+  float origj = mapping.y0 + y1*factorY, origi;
+  for (size_t j = y1; j < y2; ++j, origj += factorY) {
+    origi = mapping.x0 + x1*factorX;
+    for (size_t i = x1; i < x2; ++i, origi += factorX) {
+      sample<N, Dir>(sampler, image, origi, origj, result(i, j),
+        filterScaleX, filterScaleY);
     }
-    if (!notifyCallback_(idx, (i - resX1)*height))
-      break;
+    if (!progress((j - y1 + 1)*(x2 - x1)))
+      return false;
+  }
+
+  return true;
+}
+
+template <size_t N, int Dir, class T, class Sampler>
+LAPSE_TARGET_AVX2 bool resampleBlockAvx2(const Sampler& sampler,
+    const GenericImage<T>& image, GenericImage<T>& result, size_t x1,
+    size_t y1, size_t x2, size_t y2, const Mapping& mapping,
+    const Progress& progress)
+{
+  return resampleBlock<N, Dir>(sampler, image, result, x1, y1, x2, y2,
+    mapping, progress);
+}
+
+template <size_t N, int Dir, class T, class Sampler>
+LAPSE_TARGET_AVX512 bool resampleBlockAvx512(const Sampler& sampler,
+    const GenericImage<T>& image, GenericImage<T>& result, size_t x1,
+    size_t y1, size_t x2, size_t y2, const Mapping& mapping,
+    const Progress& progress)
+{
+  return resampleBlock<N, Dir>(sampler, image, result, x1, y1, x2, y2,
+    mapping, progress);
+}
+
+// choose the variant of the loop for this CPU
+template <size_t N, int Dir, class T, class Sampler>
+bool resampleDispatch(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t x1, size_t y1, size_t x2, size_t y2,
+    const Mapping& mapping, const Progress& progress)
+{
+  typedef bool (*Kernel)(const Sampler&, const GenericImage<T>&,
+    GenericImage<T>&, size_t, size_t, size_t, size_t, const Mapping&,
+    const Progress&);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &resampleBlock<N, Dir, T, Sampler>,
+    &resampleBlockAvx2<N, Dir, T, Sampler>,
+    &resampleBlockAvx512<N, Dir, T, Sampler>);
+  return kernel(sampler, image, result, x1, y1, x2, y2, mapping, progress);
+}
+
+// choose the loop for the channel count
+template <int Dir, class T, class Sampler>
+bool resampleDir(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t x1, size_t y1, size_t x2, size_t y2,
+    const Mapping& mapping, const Progress& progress)
+{
+  switch (image.getChannelCount()) {
+    case 1:
+      return resampleDispatch<1, Dir>(sampler, image, result, x1, y1, x2, y2,
+        mapping, progress);
+    case 3:
+      return resampleDispatch<3, Dir>(sampler, image, result, x1, y1, x2, y2,
+        mapping, progress);
+    case 4:
+      return resampleDispatch<4, Dir>(sampler, image, result, x1, y1, x2, y2,
+        mapping, progress);
+    default:
+      return resampleDispatch<0, Dir>(sampler, image, result, x1, y1, x2, y2,
+        mapping, progress);
+  }
+}
+
+// choose the loop for the direction
+template <class T, class Sampler>
+bool resampleTyped(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t x1, size_t y1, size_t x2, size_t y2,
+    typename BaseSampler<T>::Direction dir, const Mapping& mapping,
+    const Progress& progress)
+{
+  switch (dir) {
+    case BaseSampler<T>::HORIZONTAL:
+      return resampleDir<BaseSampler<T>::HORIZONTAL>(sampler, image, result,
+        x1, y1, x2, y2, mapping, progress);
+    case BaseSampler<T>::VERTICAL:
+      return resampleDir<BaseSampler<T>::VERTICAL>(sampler, image, result,
+        x1, y1, x2, y2, mapping, progress);
+    case BaseSampler<T>::BOTH:
+      return resampleDir<BaseSampler<T>::BOTH>(sampler, image, result,
+        x1, y1, x2, y2, mapping, progress);
+    default:
+      return resampleDir<BaseSampler<T>::NONE>(sampler, image, result,
+        x1, y1, x2, y2, mapping, progress);
+  }
+}
+
+/** @brief Resample the block [@a x1, @a x2) x [@a y1, @a y2) of @a result
+ *         from @a image, with a sampler whose type is known at compile time.
+ *
+ *  Returns @a false if the resizing was stopped by @a progress.
+ */
+template <class T, class Sampler>
+bool resample(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t x1, size_t y1, size_t x2, size_t y2,
+    typename BaseSampler<T>::Direction dir, const Mapping& mapping,
+    const Progress& progress)
+{
+  return resampleTyped(sampler, image, result, x1, y1, x2, y2, dir, mapping,
+    progress);
+}
+
+// for samplers chosen at run time, find the concrete type if it's one we
+// know, so that the sampling can be inlined
+template <class T>
+bool resample(const BaseSampler<T>& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, size_t x1, size_t y1, size_t x2, size_t y2,
+    typename BaseSampler<T>::Direction dir, const Mapping& mapping,
+    const Progress& progress)
+{
+  const ConvolutionSampler<T>* conv =
+    dynamic_cast<const ConvolutionSampler<T>*>(&sampler);
+  if (conv) {
+    return resampleTyped(*conv, image, result, x1, y1, x2, y2, dir,
+      mapping, progress);
+  } else {
+    return resampleTyped(sampler, image, result, x1, y1, x2, y2, dir,
+      mapping, progress);
   }
 }
 
+} // namespace resizer_detail
+
+template <class T, class Sampler>
+void Resizer<T, Sampler>::doResizeST_(const GenericImage<T>& image,
+    GenericImage<T>& result, size_t resX1, size_t resY1,
+    size_t resX2, size_t resY2, size_t idx,
+    typename BaseSampler<T>::Direction dir,
+    const resizer_detail::Mapping& mapping)
+{
+  if (!sampler_)
+    throw std::runtime_error("[Resizer::resize] No sampler set!");
+
+  resizer_detail::resample(*sampler_, image, result, resX1, resY1, resX2,
+    resY2, dir, mapping, [this, idx](size_t pixels)
+      { return notifyCallback_(idx, pixels); });
+}
+
 #endif
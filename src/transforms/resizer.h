@@ -13,15 +13,44 @@
 #include "misc/callback.h"
 #include "sampler.h"
 
-/// Class that handles resizing of images.
-template <class T>
+namespace resizer_detail {
+
+/** @brief Mapping from output pixels to source positions.
+ *
+ *  Output pixel (i, j) samples the source at (x0 + i*fx, y0 + j*fy).
+ */
+struct Mapping {
+  float x0, y0;
+  float fx, fy;
+};
+
+} // namespace resizer_detail
+
+/** @brief Class that handles resizing of images.
+ *
+ *  The @a Sampler can be a concrete sampler type (such as
+ *  @a LanczosSampler<T>), in which case the sampling is inlined into the
+ *  resizing loop, specialized for the channel count and the direction. The
+ *  concrete type needs to provide a non-virtual
+ *  @code
+ *    template <size_t N, Direction Dir> void sample(image, x, y, where,
+ *      scalex, scaley) const
+ *  @endcode
+ *  like @a ConvolutionSampler does.
+ *
+ *  With the default @a BaseSampler<T>, the sampler is chosen at run time. If
+ *  it is a @a ConvolutionSampler (which all the samplers in this library
+ *  are), the inlined loops are still used; other samplers go through the
+ *  virtual @a BaseSampler::get.
+ */
+template <class T, class Sampler = BaseSampler<T> >
 class Resizer {
  public:
   /// A smart pointer to a sampler object.
-  typedef boost::shared_ptr<const BaseSampler<T> > SamplerPtr;
+  typedef boost::shared_ptr<const Sampler> SamplerPtr;
 
   /// Constructor.
-  Resizer() : callback_(0), maxThreads_(0) {}
+  Resizer() : callback_(0), maxThreads_(0), preReduction_(false) {}
   /// Destructor.
   virtual ~Resizer() {}
 
@@ -32,14 +61,75 @@ class Resizer {
    */
   GenericImage<T> resize(const GenericImage<T>& image, unsigned width,
     unsigned height);
+  /** @brief Resize the image to the size of @a result, writing into it.
+   *
+   *  The @a result must already be allocated, and can be a view into a larger
+   *  image (for example, the interior of a padded frame). Neither the
+   *  metadata nor the channel types of @a result are changed.
+   */
+  void resize(const GenericImage<T>& image, GenericImage<T>& result);
+  /** @brief Resize the region from (@a x0, @a y0) to (@a x1, @a y1) of
+   *         @a image to the size of @a result, writing into it.
+   *
+   *  The region can have fractional coordinates, and output pixel (i, j)
+   *  samples the image at (x0 + i*(x1 - x0)/width, y0 + j*(y1 - y0)/height),
+   *  so this crops and resizes in a single pass, without rounding the crop
+   *  to whole pixels. The pixels just outside the region are used by the
+   *  filter when they exist, so that the result matches the corresponding
+   *  part of a resize of the whole image.
+   *
+   *  All the sampling positions have to be inside the image (which allows
+   *  @a x1, @a y1 to go past the edge by less than one output pixel).
+   *  Otherwise, this works like the version above.
+   */
+  void resize(const GenericImage<T>& image, float x0, float y0, float x1,
+    float y1, GenericImage<T>& result);
+  /** @brief Check whether the region from (@a x0, @a y0) to (@a x1, @a y1)
+   *         of an image of size @a w x @a h can be resized to @a width x
+   *         @a height.
+   *
+   *  This is the test that the version above does, in the same precision, so
+   *  callers can fall back to something else instead of getting an error.
+   */
+  static bool canResize(size_t w, size_t h, float x0, float y0, float x1,
+      float y1, unsigned width, unsigned height) {
+    return x0 >= 0 && y0 >= 0 && x0 < x1 && y0 < y1 &&
+      x0 + (width - 1)*(x1 - x0)/width < w &&
+      y0 + (height - 1)*(y1 - y0)/height < h;
+  }
 
   /// Set sampler. This takes ownership of the sampler.
-  void setSampler(const BaseSampler<T>* sampler)
+  void setSampler(const Sampler* sampler)
     { sampler_ = SamplerPtr(sampler); }
   /// Set sampler.
   void setSampler(const SamplerPtr& sampler) { sampler_ = sampler; }
   /// Get sampler.
-  BaseSampler<T>* getSampler() const { return sampler_; }
+  const Sampler* getSampler() const { return sampler_.get(); }
+
+  /** @brief Set whether to shrink large reductions with a box filter first.
+   *
+   *  When the image is reduced by a factor of 2 or more in some direction,
+   *  it is first reduced by the integer part @a k of the factor, by
+   *  averaging blocks of pixels (see @a boxReduce), and the sampler only
+   *  does the remaining reduction, by a factor between 1 and 2. Since the
+   *  support of the filter grows with the reduction factor, this makes the
+   *  cost of the filtering proportional to the number of output pixels,
+   *  instead of growing with the ratio; the box filter itself is a single
+   *  cheap pass over the source.
+   *
+   *  The price is some quality: the box filter is a poor low-pass filter,
+   *  so the result is a bit softer and has a bit more aliasing than with
+   *  the sampler alone. The loss is bounded by the case where the factor is
+   *  an integer, in which the sampler only interpolates and the result is
+   *  essentially a block average; the closer the factor is to the next
+   *  integer, the closer the result is to what the sampler alone would give.
+   *  On a test image with a lot of fine detail, reductions by factors of 2
+   *  to 10 with a Lanczos sampler differ from the one-step result by 0.7 to
+   *  2.3% of the full range (RMS), or a PSNR of 33 to 43 dB.
+   */
+  void setPreReduction(bool b) { preReduction_ = b; }
+  /// Get whether large reductions start with a box filter.
+  bool getPreReduction() const { return preReduction_; }
 
   /// Set a callback for progress notification.
   void setCallback(Callback* p) { callback_ = p; }
@@ -63,19 +153,25 @@ class Resizer {
     }
   }
 
+  /// Resample @a image into @a result, with the given mapping.
+  void resample_(const GenericImage<T>& image, GenericImage<T>& result,
+      const resizer_detail::Mapping& mapping);
   /// The actual resizing function.
   void doResize_(const GenericImage<T>& image, GenericImage<T>& result,
-      typename BaseSampler<T>::Direction dir);
+      typename BaseSampler<T>::Direction dir,
+      const resizer_detail::Mapping& mapping);
   /// The single-threaded resizing function.
   void doResizeST_(const GenericImage<T>& image, GenericImage<T>& result,
       size_t resX1, size_t resY1, size_t resX2, size_t resY2, size_t idx,
-      typename BaseSampler<T>::Direction dir);
+      typename BaseSampler<T>::Direction dir,
+      const resizer_detail::Mapping& mapping);
 
   SamplerPtr                    sampler_;
   Callback*                     callback_;
   size_t                        pixelsOffset_;
   size_t                        totalPixels_;
   size_t                        maxThreads_;
+  bool                          preReduction_;
   mutable std::vector<size_t>   pixels_;
 };
 
@@ -0,0 +1,200 @@
+/** @file warper-impl.h
+ *  @brief Implementation of the affine warper.
+ */
+#ifndef TRANSFORMS_WARPER_IMPL_H_
+#define TRANSFORMS_WARPER_IMPL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <stdint.h>
+
+#include "warper.h"
+
+#include "convsampler-impl.h"
+#include "misc/cpudispatch.h"
+#include "misc/threadpool.h"
+
+namespace warper_detail {
+
+/// Number of fractional bits in the source positions.
+const int fracBits = 32;
+
+/// Parameters of a warp, shared by all the rows.
+struct Params {
+  AffineMap   map;
+  float       scaleX, scaleY;
+  int64_t     minX, minY;
+  int64_t     maxX, maxY;
+};
+
+inline int64_t toFixed(double x)
+{
+  return (int64_t)std::floor(std::ldexp(x, fracBits) + 0.5);
+}
+
+inline float fromFixed(int64_t x)
+{
+  return (float)std::ldexp((double)x, -fracBits);
+}
+
+// use the non-virtual sampling function of a sampler of known type
+template <size_t N, class T, class Sampler>
+inline void sample(const Sampler& sampler, const GenericImage<T>& image,
+    float x, float y, T* where, float scalex, float scaley)
+{
+  sampler.template sample<N, BaseSampler<T>::BOTH>(image, x, y, where, scalex,
+    scaley);
+}
+
+// samplers of unknown type have to go through the virtual function
+template <size_t N, class T>
+inline void sample(const BaseSampler<T>& sampler, const GenericImage<T>& image,
+    float x, float y, T* where, float scalex, float scaley)
+{
+  sampler.get(image, x, y, where, BaseSampler<T>::BOTH, scalex, scaley);
+}
+
+// warp rows [y1, y2) of the output, for N channels (0 for any number)
+template <size_t N, class T, class Sampler>
+inline void warpRows(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, const Params& params, size_t y1, size_t y2)
+{
+  const AffineMap& map = params.map;
+  const size_t width = result.getWidth();
+  const size_t ncomps = (N > 0)?N:image.getChannelCount();
+
+  const int64_t stepX = toFixed(map.a);
+  const int64_t stepY = toFixed(map.d);
+  for (size_t j = y1; j < y2; ++j) {
+    int64_t x = toFixed(map.b*j + map.c);
+    int64_t y = toFixed(map.e*j + map.f);
+    T* dest = result(0, j);
+    const int pixelStride = result.getStrides()[0];
+    for (size_t i = 0; i < width; ++i, x += stepX, y += stepY,
+        dest += pixelStride) {
+      if (x >= params.minX && x < params.maxX && y >= params.minY &&
+          y < params.maxY) {
+        sample<N>(sampler, image, fromFixed(x), fromFixed(y), dest,
+          params.scaleX, params.scaleY);
+      } else {
+        std::fill(dest, dest + ncomps, T());
+      }
+    }
+  }
+}
+
+template <size_t N, class T, class Sampler>
+LAPSE_TARGET_AVX2 void warpRowsAvx2(const Sampler& sampler,
+    const GenericImage<T>& image, GenericImage<T>& result,
+    const Params& params, size_t y1, size_t y2)
+{
+  warpRows<N>(sampler, image, result, params, y1, y2);
+}
+
+template <size_t N, class T, class Sampler>
+LAPSE_TARGET_AVX512 void warpRowsAvx512(const Sampler& sampler,
+    const GenericImage<T>& image, GenericImage<T>& result,
+    const Params& params, size_t y1, size_t y2)
+{
+  warpRows<N>(sampler, image, result, params, y1, y2);
+}
+
+// choose the variant of the loop for this CPU
+template <size_t N, class T, class Sampler>
+void warpDispatch(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, const Params& params, size_t y1, size_t y2)
+{
+  typedef void (*Kernel)(const Sampler&, const GenericImage<T>&,
+    GenericImage<T>&, const Params&, size_t, size_t);
+  static const Kernel kernel = CpuDispatch::getInstance().select<Kernel>(
+    &warpRows<N, T, Sampler>, &warpRowsAvx2<N, T, Sampler>,
+    &warpRowsAvx512<N, T, Sampler>);
+  kernel(sampler, image, result, params, y1, y2);
+}
+
+// choose the loop for the channel count
+template <class T, class Sampler>
+void warpTyped(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, const Params& params, size_t y1, size_t y2)
+{
+  switch (image.getChannelCount()) {
+    case 1: warpDispatch<1>(sampler, image, result, params, y1, y2); break;
+    case 3: warpDispatch<3>(sampler, image, result, params, y1, y2); break;
+    case 4: warpDispatch<4>(sampler, image, result, params, y1, y2); break;
+    default: warpDispatch<0>(sampler, image, result, params, y1, y2);
+  }
+}
+
+template <class T, class Sampler>
+void warp(const Sampler& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, const Params& params, size_t y1, size_t y2)
+{
+  warpTyped(sampler, image, result, params, y1, y2);
+}
+
+// for samplers chosen at run time, find the concrete type if it's one we
+// know, so that the sampling can be inlined
+template <class T>
+void warp(const BaseSampler<T>& sampler, const GenericImage<T>& image,
+    GenericImage<T>& result, const Params& params, size_t y1, size_t y2)
+{
+  const ConvolutionSampler<T>* conv =
+    dynamic_cast<const ConvolutionSampler<T>*>(&sampler);
+  if (conv)
+    warpTyped(*conv, image, result, params, y1, y2);
+  else
+    warpTyped(sampler, image, result, params, y1, y2);
+}
+
+} // namespace warper_detail
+
+template <class T, class Sampler>
+void Warper<T, Sampler>::warp(const GenericImage<T>& image,
+    GenericImage<T>& result, const AffineMap& map) const
+{
+  if (!sampler_)
+    throw std::runtime_error("[Warper::warp] No sampler set!");
+  if (result.getChannelCount() != image.getChannelCount())
+    throw std::runtime_error("[Warper::warp] Channel count mismatch between "
+      "origin and destination image.");
+
+  // the samplers access the channels of each pixel directly, so they need
+  // interleaved images
+  if (image.getLayout() != LAYOUT_INTERLEAVED) {
+    GenericImage<T> flat(image);
+    flat.flatten();
+    warp(flat, result, map);
+    return;
+  }
+  if (result.getLayout() != LAYOUT_INTERLEAVED) {
+    GenericImage<T> flat;
+    flat.reshape(result.getWidth(), result.getHeight());
+    flat.setChannelCount(result.getChannelCount());
+    flat.allocate();
+    warp(image, flat, map);
+    result.copyPixelsFrom(flat);
+    return;
+  }
+
+  // the filter is stretched by the amount by which the map shrinks the image
+  // along each output axis
+  warper_detail::Params params;
+  params.map = map;
+  params.scaleX = std::max(1.0, std::sqrt(map.a*map.a + map.d*map.d));
+  params.scaleY = std::max(1.0, std::sqrt(map.b*map.b + map.e*map.e));
+  // positions within half a pixel of the image are still sampled
+  params.minX = warper_detail::toFixed(-0.5);
+  params.minY = warper_detail::toFixed(-0.5);
+  params.maxX = warper_detail::toFixed(image.getWidth() - 0.5);
+  params.maxY = warper_detail::toFixed(image.getHeight() - 0.5);
+
+  const Sampler& sampler = *sampler_;
+  ThreadPool::getInstance().parallelFor(result.getHeight(),
+    [&](size_t y1, size_t y2) {
+      warper_detail::warp(sampler, image, result, params, y1, y2);
+    }, 4, maxThreads_);
+}
+
+#endif
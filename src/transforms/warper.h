@@ -0,0 +1,83 @@
+/** @file warper.h
+ *  @brief Affine warping of images.
+ */
+#ifndef TRANSFORMS_WARPER_H_
+#define TRANSFORMS_WARPER_H_
+
+#include <boost/shared_ptr.hpp>
+
+#include "image/image.h"
+#include "sampler.h"
+
+/** @brief An affine map from output pixels to source positions.
+ *
+ *  Output pixel (i, j) samples the source at
+ *  (a*i + b*j + c, d*i + e*j + f).
+ */
+struct AffineMap {
+  double a, b, c;
+  double d, e, f;
+
+  /// The identity map.
+  static AffineMap identity() { return AffineMap{1, 0, 0, 0, 1, 0}; }
+
+  /** @brief Compose with another map: the result first applies @a other,
+   *         then this map.
+   */
+  AffineMap after(const AffineMap& other) const {
+    return AffineMap{
+      a*other.a + b*other.d, a*other.b + b*other.e, a*other.c + b*other.f + c,
+      d*other.a + e*other.d, d*other.b + e*other.e, d*other.c + e*other.f + f};
+  }
+};
+
+/** @brief Class that applies affine transformations (rotation, scaling,
+ *         shearing, translation) to images.
+ *
+ *  Each output pixel is sampled with the 2d kernel of the sampler, scaled
+ *  to the amount by which the map shrinks the image, so that reductions are
+ *  properly filtered. Like in @a Resizer, the @a Sampler can be a concrete
+ *  type, or @a BaseSampler<T> to choose it at run time.
+ *
+ *  Source positions are stepped along each row in 32.32 fixed point, so
+ *  there is no need for a multiplication per pixel, and no drift along the
+ *  row; the position at the start of each row is calculated directly.
+ *  Output pixels that map outside the image are set to zero.
+ */
+template <class T, class Sampler = BaseSampler<T> >
+class Warper {
+ public:
+  /// A smart pointer to a sampler object.
+  typedef boost::shared_ptr<const Sampler> SamplerPtr;
+
+  /// Constructor.
+  Warper() : maxThreads_(0) {}
+
+  /** @brief Warp @a image into @a result, using the given map.
+   *
+   *  @a result must already be allocated, with the same number of channels
+   *  as @a image. Neither its metadata nor its channel types are changed.
+   */
+  void warp(const GenericImage<T>& image, GenericImage<T>& result,
+    const AffineMap& map) const;
+
+  /// Set sampler. This takes ownership of the sampler.
+  void setSampler(const Sampler* sampler) { sampler_ = SamplerPtr(sampler); }
+  /// Set sampler.
+  void setSampler(const SamplerPtr& sampler) { sampler_ = sampler; }
+  /// Get sampler.
+  const Sampler* getSampler() const { return sampler_.get(); }
+
+  /** @brief Set maximum number of threads to use.
+   *
+   *  Use 1 to force single-threaded execution, 0 to use all the threads of
+   *  the shared @a ThreadPool.
+   */
+  void setMaxThreads(size_t n) { maxThreads_ = n; }
+
+ protected:
+  SamplerPtr    sampler_;
+  size_t        maxThreads_;
+};
+
+#endif